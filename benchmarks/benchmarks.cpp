@@ -0,0 +1,757 @@
+
+/**
+ * Microbenchmarks of the viewer's hot paths - token parsing, Function
+ * construction, and the YX/address queries that retdec_place_t and the
+ * custom viewer make while the user scrolls and moves around.
+ *
+ * Runs without IDA (see src/idastub). Token streams are either synthetic
+ * (of several sizes), or recorded - i.e. RetDec's JSON output (e.g. written
+ * by "retdec-replay --output").
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include <retdec/common/address.h>
+
+#include "idaplugin/function.h"
+#include "idaplugin/token.h"
+#include "idaplugin/tokenstream.h"
+
+//
+//==============================================================================
+// Allocation counting
+//==============================================================================
+//
+
+namespace {
+
+std::atomic<std::size_t> allocations(0);
+
+} // anonymous namespace
+
+void* operator new(std::size_t size)
+{
+	++allocations;
+	if (void* p = std::malloc(size ? size : 1))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	++allocations;
+	if (void* p = std::malloc(size ? size : 1))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace {
+
+//
+//==============================================================================
+// Token streams
+//==============================================================================
+//
+
+struct TokenStream
+{
+	std::string name;
+	ea_t start = 0;
+	ea_t end = 0;
+	std::vector<Token> tokens;
+	std::string json;
+};
+
+const char* kindJsonName(Token::Kind k)
+{
+	switch (k)
+	{
+		case Token::Kind::NEW_LINE: return "nl";
+		case Token::Kind::WHITE_SPACE: return "ws";
+		case Token::Kind::PUNCTUATION: return "punc";
+		case Token::Kind::OPERATOR: return "op";
+		case Token::Kind::ID_GVAR: return "i_gvar";
+		case Token::Kind::ID_LVAR: return "i_lvar";
+		case Token::Kind::ID_MEM: return "i_mem";
+		case Token::Kind::ID_LAB: return "i_lab";
+		case Token::Kind::ID_FNC: return "i_fnc";
+		case Token::Kind::ID_ARG: return "i_arg";
+		case Token::Kind::KEYWORD: return "keyw";
+		case Token::Kind::TYPE: return "type";
+		case Token::Kind::PREPROCESSOR: return "preproc";
+		case Token::Kind::INCLUDE: return "inc";
+		case Token::Kind::LITERAL_BOOL: return "l_bool";
+		case Token::Kind::LITERAL_INT: return "l_int";
+		case Token::Kind::LITERAL_FP: return "l_fp";
+		case Token::Kind::LITERAL_STR: return "l_str";
+		case Token::Kind::LITERAL_SYM: return "l_sym";
+		case Token::Kind::LITERAL_PTR: return "l_ptr";
+		case Token::Kind::COMMENT: return "cmnt";
+	}
+	return "ws";
+}
+
+std::string jsonEscape(const std::string& s)
+{
+	std::string ret;
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\') ret += '\\';
+		ret += c;
+	}
+	return ret;
+}
+
+/**
+ * RetDec's JSON output format - address objects are emitted only when the
+ * address changes, the same as RetDec does.
+ */
+std::string toJson(const std::vector<Token>& tokens)
+{
+	std::stringstream ss;
+	ss << "{\"language\":\"C\",\"tokens\":[";
+	ea_t ea = BADADDR;
+	bool first = true;
+	for (auto& t : tokens)
+	{
+		if (!first) ss << ",";
+		first = false;
+		if (t.ea != ea)
+		{
+			ea = t.ea;
+			ss << "{\"addr\":\"0x" << std::hex << ea << std::dec << "\"},";
+		}
+		ss << "{\"kind\":\"" << kindJsonName(t.kind)
+				<< "\",\"val\":\"" << jsonEscape(t.value) << "\"}";
+	}
+	ss << "]}";
+	return ss.str();
+}
+
+/**
+ * Deterministic C-like token stream with about \p count tokens.
+ */
+TokenStream syntheticStream(std::size_t count)
+{
+	static const std::vector<std::string> types = {"int32_t", "char *", "uint64_t"};
+	static const std::vector<std::string> ops = {"=", "+", "-", "*", "&", "<<", "=="};
+	static const std::vector<std::string> keywords = {"if", "while"};
+
+	TokenStream s;
+	s.name = "synthetic-" + std::to_string(count);
+	s.start = 0x401000;
+
+	std::mt19937 rng(count);
+	auto pick = [&rng](const std::vector<std::string>& v) -> const std::string&
+	{
+		return v[rng() % v.size()];
+	};
+	auto add = [&s](Token::Kind k, ea_t ea, const std::string& v)
+	{
+		s.tokens.emplace_back(Token(k, ea, v));
+	};
+
+	ea_t ea = s.start;
+	add(Token::Kind::TYPE, ea, "int32_t");
+	add(Token::Kind::WHITE_SPACE, ea, " ");
+	add(Token::Kind::ID_FNC, ea, "function_401000");
+	add(Token::Kind::PUNCTUATION, ea, "(");
+	add(Token::Kind::TYPE, ea, "int32_t");
+	add(Token::Kind::WHITE_SPACE, ea, " ");
+	add(Token::Kind::ID_ARG, ea, "a1");
+	add(Token::Kind::PUNCTUATION, ea, ")");
+	add(Token::Kind::WHITE_SPACE, ea, " ");
+	add(Token::Kind::PUNCTUATION, ea, "{");
+	add(Token::Kind::NEW_LINE, ea, "\n");
+
+	unsigned depth = 1;
+	while (s.tokens.size() < count)
+	{
+		ea += 1 + rng() % 8;
+		std::string indent(4 * depth, ' ');
+		std::string var = "v" + std::to_string(rng() % 64);
+
+		switch (rng() % 6)
+		{
+			case 0: // declaration
+				add(Token::Kind::WHITE_SPACE, ea, indent);
+				add(Token::Kind::TYPE, ea, pick(types));
+				add(Token::Kind::WHITE_SPACE, ea, " ");
+				add(Token::Kind::ID_LVAR, ea, var);
+				add(Token::Kind::PUNCTUATION, ea, ";");
+				break;
+			case 1: // call
+				add(Token::Kind::WHITE_SPACE, ea, indent);
+				add(Token::Kind::ID_FNC, ea, "function_" + std::to_string(rng() % 512));
+				add(Token::Kind::PUNCTUATION, ea, "(");
+				add(Token::Kind::ID_GVAR, ea, "g" + std::to_string(rng() % 32));
+				add(Token::Kind::PUNCTUATION, ea, ", ");
+				add(Token::Kind::LITERAL_STR, ea, "\"string literal\"");
+				add(Token::Kind::PUNCTUATION, ea, ");");
+				break;
+			case 2: // block start
+				if (depth < 8)
+				{
+					add(Token::Kind::WHITE_SPACE, ea, indent);
+					add(Token::Kind::KEYWORD, ea, pick(keywords));
+					add(Token::Kind::WHITE_SPACE, ea, " ");
+					add(Token::Kind::PUNCTUATION, ea, "(");
+					add(Token::Kind::ID_LVAR, ea, var);
+					add(Token::Kind::WHITE_SPACE, ea, " ");
+					add(Token::Kind::OPERATOR, ea, "!=");
+					add(Token::Kind::WHITE_SPACE, ea, " ");
+					add(Token::Kind::LITERAL_INT, ea, "0");
+					add(Token::Kind::PUNCTUATION, ea, ")");
+					add(Token::Kind::WHITE_SPACE, ea, " ");
+					add(Token::Kind::PUNCTUATION, ea, "{");
+					++depth;
+					break;
+				}
+				// fall-through
+			case 3: // block end
+				if (depth > 1)
+				{
+					--depth;
+					add(Token::Kind::WHITE_SPACE, ea, std::string(4 * depth, ' '));
+					add(Token::Kind::PUNCTUATION, ea, "}");
+					break;
+				}
+				// fall-through
+			case 4: // comment
+				add(Token::Kind::WHITE_SPACE, ea, indent);
+				add(Token::Kind::COMMENT, ea, "// 0x" + std::to_string(ea));
+				break;
+			default: // assignment
+				add(Token::Kind::WHITE_SPACE, ea, indent);
+				add(Token::Kind::ID_LVAR, ea, var);
+				add(Token::Kind::WHITE_SPACE, ea, " ");
+				add(Token::Kind::OPERATOR, ea, "=");
+				add(Token::Kind::WHITE_SPACE, ea, " ");
+				add(Token::Kind::ID_ARG, ea, "a1");
+				add(Token::Kind::WHITE_SPACE, ea, " ");
+				add(Token::Kind::OPERATOR, ea, pick(ops));
+				add(Token::Kind::WHITE_SPACE, ea, " ");
+				add(Token::Kind::LITERAL_INT, ea, std::to_string(rng() % 1000));
+				add(Token::Kind::PUNCTUATION, ea, ";");
+				break;
+		}
+		add(Token::Kind::NEW_LINE, ea, "\n");
+	}
+	while (depth-- > 0)
+	{
+		add(Token::Kind::WHITE_SPACE, ea, std::string(4 * depth, ' '));
+		add(Token::Kind::PUNCTUATION, ea, "}");
+		add(Token::Kind::NEW_LINE, ea, "\n");
+	}
+
+	s.end = ea + 1;
+	s.json = toJson(s.tokens);
+	return s;
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool recordedStream(const std::string& path, TokenStream& s)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs)
+	{
+		std::cerr << "Error: unable to read: " << path << "\n";
+		return true;
+	}
+	std::stringstream buff;
+	buff << ifs.rdbuf();
+
+	s.name = path;
+	s.json = buff.str();
+	s.tokens = parseTokens(s.json, 0);
+	if (s.tokens.empty())
+	{
+		std::cerr << "Error: no tokens in: " << path << "\n";
+		return true;
+	}
+
+	s.start = BADADDR;
+	s.end = 0;
+	for (auto& t : s.tokens)
+	{
+		if (t.ea == 0 || t.ea == BADADDR) continue;
+		s.start = std::min(s.start, t.ea);
+		s.end = std::max(s.end, t.ea + 1);
+	}
+	if (s.start == BADADDR)
+	{
+		s.start = 0;
+		s.end = 1;
+	}
+	return false;
+}
+
+/**
+ * The former DOM-based parseTokens() - the baseline of the streaming one.
+ */
+std::vector<Token> parseTokensDom(const std::string& json, ea_t defaultEa)
+{
+	std::vector<Token> res;
+
+	rapidjson::Document d;
+	d.Parse(json.c_str());
+	auto tokens = d.IsObject() ? d.FindMember("tokens") : d.MemberEnd();
+	if (d.HasParseError() || tokens == d.MemberEnd()
+			|| !tokens->value.IsArray())
+	{
+		return res;
+	}
+
+	static const std::map<std::string, Token::Kind> kinds = []()
+	{
+		std::map<std::string, Token::Kind> ret;
+		for (int k = 0; k <= int(Token::Kind::COMMENT); ++k)
+		{
+			ret[kindJsonName(Token::Kind(k))] = Token::Kind(k);
+		}
+		return ret;
+	}();
+
+	ea_t ea = defaultEa;
+	for (auto& obj : tokens->value.GetArray())
+	{
+		if (!obj.IsObject())
+		{
+			continue;
+		}
+		auto addr = obj.FindMember("addr");
+		if (addr != obj.MemberEnd() && addr->value.IsString())
+		{
+			retdec::common::Address a(addr->value.GetString());
+			ea = a.isDefined() ? a.getValue() : defaultEa;
+		}
+		auto kind = obj.FindMember("kind");
+		auto val = obj.FindMember("val");
+		if (kind != obj.MemberEnd() && kind->value.IsString()
+				&& val != obj.MemberEnd() && val->value.IsString())
+		{
+			auto k = kinds.find(kind->value.GetString());
+			if (k != kinds.end())
+			{
+				res.emplace_back(Token(k->second, ea, val->value.GetString()));
+			}
+		}
+	}
+
+	return res;
+}
+
+class VectorSink : public TokenSink
+{
+	public:
+		VectorSink(std::vector<Token>& tokens) : _tokens(tokens) {}
+
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value) override
+		{
+			_tokens.emplace_back(kind, ea, value);
+		}
+
+	private:
+		std::vector<Token>& _tokens;
+};
+
+std::string encodeTokens(const std::vector<Token>& tokens)
+{
+	TokenWriter writer;
+	for (auto& t : tokens)
+	{
+		writer.token(t.kind, t.ea, t.value);
+	}
+	return writer.finish();
+}
+
+/**
+ * Returns \c true if the token stream does not round-trip.
+ */
+bool checkTokenStream(const TokenStream& s, const std::string& stream)
+{
+	auto tokens = parseTokens(stream, s.start);
+	bool same = tokens.size() == s.tokens.size();
+	for (std::size_t i = 0; same && i < tokens.size(); ++i)
+	{
+		same = tokens[i].kind == s.tokens[i].kind
+				&& tokens[i].ea == s.tokens[i].ea
+				&& tokens[i].value == s.tokens[i].value;
+	}
+
+	// Truncated streams must be rejected, not misread.
+	for (std::size_t size : {stream.size() - 1, stream.size() / 2, std::size_t(5)})
+	{
+		TokenReader reader;
+		std::vector<Token> ts;
+		VectorSink sink(ts);
+		same &= reader.open(stream.data(), size) || reader.read(sink);
+	}
+
+	if (!same)
+	{
+		std::cerr << "Error: token stream does not round-trip on "
+				<< s.name << "\n";
+	}
+	return !same;
+}
+
+bool sameTokens(const std::vector<Token>& a, const std::vector<Token>& b)
+{
+	bool same = a.size() == b.size();
+	for (std::size_t i = 0; same && i < a.size(); ++i)
+	{
+		same = a[i].kind == b[i].kind
+				&& a[i].ea == b[i].ea
+				&& a[i].value == b[i].value;
+	}
+	return same;
+}
+
+/**
+ * Returns \c true if the streaming, file, and DOM parsers disagree.
+ */
+bool checkParsers(const TokenStream& s, const std::string& jsonPath)
+{
+	auto dom = parseTokensDom(s.json, s.start);
+	auto sax = parseTokens(s.json, s.start);
+	std::vector<Token> file;
+	VectorSink fileSink(file);
+	bool same = sameTokens(dom, sax)
+			&& !parseTokensFile(jsonPath, s.start, fileSink)
+			&& sameTokens(sax, file);
+	if (!same)
+	{
+		std::cerr << "Error: parseTokens(), parseTokensFile(), and the DOM "
+				"parser disagree on " << s.name << "\n";
+	}
+	return !same;
+}
+
+//
+//==============================================================================
+// Benchmark harness
+//==============================================================================
+//
+
+/**
+ * Run \p body (which processes \p items items) repeatedly for at least
+ * \p minTime seconds and print throughput and allocations per item.
+ */
+void bench(
+		const std::string& name,
+		std::size_t items,
+		const std::function<void()>& body,
+		double minTime = 0.2)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::size_t runs = 0;
+	std::size_t allocs = 0;
+	std::chrono::duration<double> total(0);
+	do
+	{
+		std::size_t a = allocations;
+		auto start = clock::now();
+		body();
+		total += clock::now() - start;
+		allocs += allocations - a;
+		++runs;
+	}
+	while (total.count() < minTime);
+
+	double perRun = total.count() / runs;
+	double n = std::max<std::size_t>(items, 1);
+	std::cout << "  " << std::left << std::setw(26) << name
+			<< std::right << std::fixed
+			<< std::setw(12) << std::setprecision(3) << perRun * 1.0e3 << " ms/run"
+			<< std::setw(14) << std::setprecision(0) << n / perRun << " items/s"
+			<< std::setw(10) << std::setprecision(2) << allocs / double(runs) / n
+			<< " allocs/item\n";
+}
+
+volatile std::size_t sink = 0;
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool runBenchmarks(const TokenStream& s)
+{
+	std::cout << s.name << ": " << s.tokens.size() << " tokens, "
+			<< s.json.size() << " B JSON\n";
+
+	auto jsonPath = (std::filesystem::temp_directory_path()
+			/ "retdec-idaplugin-benchmarks.json").string();
+	std::ofstream(jsonPath, std::ios::binary) << s.json;
+
+	auto stream = encodeTokens(s.tokens);
+	bool failed = checkParsers(s, jsonPath) || checkTokenStream(s, stream);
+	if (failed)
+	{
+		std::filesystem::remove(jsonPath);
+		return true;
+	}
+	std::cout << "  token stream: " << stream.size() << " B ("
+			<< std::fixed << std::setprecision(1)
+			<< 100.0 * stream.size() / s.json.size() << " % of JSON)\n";
+
+	bench("parseTokens (DOM)", s.tokens.size(), [&s]()
+	{
+		sink += parseTokensDom(s.json, s.start).size();
+	});
+
+	bench("parseTokens", s.tokens.size(), [&s]()
+	{
+		sink += parseTokens(s.json, s.start).size();
+	});
+
+	// Full decompilation streams the output from a file.
+	bench("parseTokensFile", s.tokens.size(), [&s, &jsonPath]()
+	{
+		std::vector<Token> ts;
+		VectorSink tokenSink(ts);
+		parseTokensFile(jsonPath, s.start, tokenSink);
+		sink += ts.size();
+	});
+	std::filesystem::remove(jsonPath);
+
+	func_t f(s.start, s.end);
+	bench("Function::Function", s.tokens.size(), [&s, &f]()
+	{
+		Function fnc(&f, s.tokens);
+		sink += fnc.getTokens().size();
+	});
+
+	// JSON -> Function, the way selective decompilation did it before and
+	// does it now.
+	bench("DOM + Function::Function", s.tokens.size(), [&s, &f]()
+	{
+		Function fnc(&f, parseTokensDom(s.json, s.start));
+		sink += fnc.getTokens().size();
+	});
+
+	bench("parseTokens -> Builder", s.tokens.size(), [&s, &f]()
+	{
+		FunctionBuilder builder(&f);
+		parseTokens(s.json, s.start, builder);
+		sink += builder.take().getTokens().size();
+	});
+
+	bench("TokenWriter", s.tokens.size(), [&s]()
+	{
+		sink += encodeTokens(s.tokens).size();
+	});
+
+	bench("TokenReader::next", s.tokens.size(), [&stream]()
+	{
+		TokenReader reader;
+		reader.open(stream.data(), stream.size());
+		Token::Kind kind;
+		ea_t ea;
+		std::string_view value;
+		while (reader.next(kind, ea, value))
+		{
+			sink += value.size();
+		}
+	});
+
+	bench("TokenReader -> Builder", s.tokens.size(), [&s, &f, &stream]()
+	{
+		FunctionBuilder builder(&f);
+		parseTokens(stream, s.start, builder);
+		sink += builder.take().getTokens().size();
+	});
+
+	Function fnc(&f, s.tokens);
+	auto lines = fnc.max_yx().y;
+
+	std::mt19937 rng(42);
+	const std::size_t queries = 100000;
+	std::vector<YX> yxs;
+	std::vector<ea_t> eas;
+	for (std::size_t i = 0; i < queries; ++i)
+	{
+		yxs.emplace_back(YX(1 + rng() % lines, rng() % 80));
+		eas.push_back(s.start + rng() % (s.end - s.start));
+	}
+
+	bench("adjust_yx", queries, [&fnc, &yxs]()
+	{
+		for (auto& yx : yxs) sink += fnc.adjust_yx(yx).x;
+	});
+
+	bench("ea_2_yx", queries, [&fnc, &eas]()
+	{
+		for (auto ea : eas) sink += fnc.ea_2_yx(ea).y;
+	});
+
+	bench("line_yx", lines, [&fnc, lines]()
+	{
+		for (std::size_t y = YX::starting_y; y <= lines; ++y)
+		{
+			sink += fnc.line_yx(YX(y, 0)).size();
+		}
+	});
+
+	bench("toLines", lines, [&fnc]()
+	{
+		sink += fnc.toLines().size();
+	});
+
+	// Occurrences of the most frequent identifier - highlighting and
+	// next/previous occurrence by the index, and by scanning the tokens.
+	const Token* ident = nullptr;
+	std::size_t occurrences = 0;
+	for (auto& t : fnc.getTokens())
+	{
+		auto n = fnc.getOccurrences(t.second.kind, t.second.value).size();
+		if (n > occurrences)
+		{
+			occurrences = n;
+			ident = &t.second;
+		}
+	}
+	if (ident)
+	{
+		auto first = fnc.getOccurrences(ident->kind, ident->value).front();
+		bench("next_occurrence", occurrences, [&fnc, first, occurrences]()
+		{
+			YX yx = first;
+			for (std::size_t i = 0; i < occurrences; ++i)
+			{
+				yx = fnc.next_occurrence(yx);
+				sink += yx.x;
+			}
+		});
+
+		bench("occurrences (scan)", occurrences, [&fnc, ident]()
+		{
+			for (auto& t : fnc.getTokens())
+			{
+				if (t.second.kind == ident->kind && t.second.value == ident->value)
+				{
+					sink += t.first.x;
+				}
+			}
+		});
+	}
+
+	// The calls retdec_place_t::next()/prev()/generate() make while the
+	// viewer walks the whole function down and back up, one line at a time.
+	bench("place next/prev/generate", 2 * lines, [&fnc]()
+	{
+		YX yx = fnc.min_yx();
+		while (true)
+		{
+			sink += fnc.line_yx(yx).size();
+			auto nyx = fnc.next_yx(yx);
+			if (yx >= fnc.max_yx() || nyx == yx) break;
+			yx = nyx;
+		}
+		while (true)
+		{
+			sink += fnc.line_yx(yx).size();
+			auto pyx = fnc.prev_yx(yx);
+			if (yx <= fnc.min_yx() || pyx == yx) break;
+			yx = pyx;
+		}
+	});
+
+	std::cout << "\n";
+	return false;
+}
+
+void printUsage(std::ostream& os)
+{
+	os << "Usage: retdec-idaplugin-benchmarks [--max-tokens N] [JSON...]\n"
+		<< "\n"
+		<< "Runs the benchmarks on synthetic token streams of 100 to N\n"
+		<< "(default: 1000000) tokens, and on the given RetDec JSON outputs.\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	std::size_t maxTokens = 1000000;
+	std::vector<std::string> recorded;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string a = argv[i];
+		if (a == "--max-tokens" && i + 1 < argc)
+		{
+			maxTokens = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (a == "-h" || a == "--help" || a.compare(0, 2, "--") == 0)
+		{
+			printUsage(a == "-h" || a == "--help" ? std::cout : std::cerr);
+			return a == "-h" || a == "--help" ? 0 : 1;
+		}
+		else
+		{
+			recorded.push_back(a);
+		}
+	}
+
+	for (std::size_t n = 100; n <= maxTokens; n *= 10)
+	{
+		if (runBenchmarks(syntheticStream(n)))
+		{
+			return 1;
+		}
+	}
+	for (auto& path : recorded)
+	{
+		TokenStream s;
+		if (recordedStream(path, s) || runBenchmarks(s))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
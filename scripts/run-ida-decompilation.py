@@ -4,14 +4,35 @@
 The supported decompilation modes are:
    full      - decompile entire input file.
    selective - decompile only the function selected by the given address.
+
+Corpus benchmark mode (--corpus DIR) decompiles all the files in the given
+directory (full decompilation and/or selective decompilation of addresses
+listed in "<file>.functions" side files, one address per line) by a pool of
+workers and writes a CSV/JSON report with wall times, peak RSS, and output
+sizes. Jobs can be run with several decompilation profiles (--profile) to
+compare their latency and output sizes. Two reports can be compared by
+--compare OLD NEW.
+
+Batch mode (--batch MANIFEST) decompiles the files listed in a manifest by
+a pool of workers with per-job timeouts and memory limits. Results are
+stored by the input's SHA-256 - already decompiled samples are skipped, so
+re-submitted samples are free and interrupted batches resume where they
+left off.
 """
 
 import argparse
+import concurrent.futures
+import csv
+import hashlib
+import json
 import os
 import shutil
 import signal
+import statistics
 import subprocess
 import sys
+import tempfile
+import time
 
 
 script_full = 'retdec-decompile-full.idc'
@@ -19,6 +40,17 @@ script_selective = 'retdec-decompile-selective.idc'
 
 TIMEOUT_RC = 137
 
+# Side files of corpus inputs - not decompiled themselves.
+functions_suffix = '.functions'
+corpus_ignored_suffixes = (functions_suffix, '.c', '.json', '.idb', '.i64',
+                           '.id0', '.id1', '.id2', '.nam', '.til', '.log')
+
+# Batch result store layout: <results>/<sha256[:2]>/<sha256>/<job>.{c,json}
+batch_result_suffix = '.json'
+
+report_fields = ['file', 'mode', 'address', 'profile', 'status', 'rc', 'wall_time',
+                 'peak_rss', 'output_size']
+
 
 def is_windows():
     return sys.platform in ('win32', 'msys') or os.name == 'nt'
@@ -35,6 +67,7 @@ def parse_args(args):
 
     parser.add_argument('file',
                         metavar='FILE',
+                        nargs='?',
                         help='The input file.')
 
     parser.add_argument('-o', '--output',
@@ -61,10 +94,83 @@ def parse_args(args):
                         action='store_true',
                         help='Use 64-bit address space plugin, i.e. retdec64 library and idat64 executable.')
 
+    parser.add_argument('--timeout',
+                        dest='timeout',
+                        type=float,
+                        help='Kill the decompilation after the given number of seconds.')
+
+    parser.add_argument('--memory-limit',
+                        dest='memory_limit',
+                        type=int,
+                        metavar='MB',
+                        help='Limit the address space of IDA to the given number of MB (POSIX only).')
+
+    parser.add_argument('-p', '--profile',
+                        dest='profile',
+                        default='',
+                        help='Decompilation profile (see decompiler-profiles.json), passed to the plugin in the RETDEC_PROFILE environment variable. Corpus benchmark accepts a comma-separated list and runs every job with each of the profiles.')
+
+    corpus = parser.add_argument_group('corpus benchmark')
+
+    corpus.add_argument('--corpus',
+                        dest='corpus_dir',
+                        metavar='DIR',
+                        help='Decompile all the files in the given directory and write a report.')
+
+    corpus.add_argument('--mode',
+                        dest='mode',
+                        choices=['full', 'selective', 'both'],
+                        default='both',
+                        help='Corpus decompilation mode. Selective decompilation uses addresses from "<file>%s" side files.' % functions_suffix)
+
+    corpus.add_argument('-j', '--jobs',
+                        dest='jobs',
+                        type=int,
+                        default=1,
+                        help='Number of parallel IDA instances.')
+
+    corpus.add_argument('-r', '--report',
+                        dest='report',
+                        metavar='FILE',
+                        help='Report file (default for corpus: retdec-benchmark.csv). The format (CSV or JSON) is chosen by the file extension.')
+
+    corpus.add_argument('--keep',
+                        dest='keep',
+                        action='store_true',
+                        help='Keep the working directories (IDBs, outputs) of corpus jobs.')
+
+    corpus.add_argument('--compare',
+                        dest='compare',
+                        nargs=2,
+                        metavar=('OLD', 'NEW'),
+                        help='Compare two corpus reports and exit.')
+
+    batch = parser.add_argument_group('batch')
+
+    batch.add_argument('--batch',
+                       dest='batch',
+                       metavar='MANIFEST',
+                       help='Decompile the files listed in the manifest. One file per line, optionally followed by addresses for selective decompilation; relative paths are relative to the manifest; "#" starts a comment.')
+
+    batch.add_argument('--results',
+                       dest='results_dir',
+                       metavar='DIR',
+                       default='retdec-results',
+                       help='Batch result store (results are stored by input SHA-256).')
+
+    batch.add_argument('--retry-failed',
+                       dest='retry_failed',
+                       action='store_true',
+                       help='Re-run jobs whose stored result is a failure or a timeout.')
+
     return parser.parse_args(args)
 
 
-def check_args(args):
+def check_ida(args):
+    args.profiles = args.profile.split(',') if args.profile else ['']
+    if len(args.profiles) > 1 and (args.batch or not args.corpus_dir):
+        print_error_and_die('Multiple profiles are supported only by the corpus benchmark.')
+
     if args.ida_dir is None:
         print_error_and_die('Path to IDA directory was not specified.')
     if not os.path.isdir(args.ida_dir):
@@ -77,6 +183,12 @@ def check_args(args):
 
     if not os.path.exists(args.idat_path):
         print_error_and_die('IDA console application does not exist:', args.idat_path)
+    # Corpus jobs run in their own working directories.
+    args.idat_path = os.path.abspath(args.idat_path)
+
+
+def check_args(args):
+    check_ida(args)
 
     if args.idb_path and not os.path.exists(args.idb_path):
         print_error_and_die('Specified IDB file does not exist:', args.idb_path)
@@ -93,42 +205,489 @@ def check_args(args):
         print_error_and_die('Output directory does not exist:', args.output_dir)
 
 
+def check_corpus_args(args):
+    check_ida(args)
+
+    if not os.path.isdir(args.corpus_dir):
+        print_error_and_die('Specified corpus is not a directory:', args.corpus_dir)
+    if args.jobs < 1:
+        print_error_and_die('Invalid number of jobs:', args.jobs)
+
+    if not args.report:
+        args.report = 'retdec-benchmark.csv'
+    check_report(args.report)
+
+
+def check_batch_args(args):
+    check_ida(args)
+
+    if not os.path.isfile(args.batch):
+        print_error_and_die('Specified manifest does not exist:', args.batch)
+    if args.jobs < 1:
+        print_error_and_die('Invalid number of jobs:', args.jobs)
+    if args.report:
+        check_report(args.report)
+    os.makedirs(args.results_dir, exist_ok=True)
+
+
+def check_report(path):
+    report_dir = os.path.dirname(os.path.abspath(path))
+    if not os.path.isdir(report_dir):
+        print_error_and_die('Report directory does not exist:', report_dir)
+
+
+class RunResult:
+    """Resources consumed by one IDA run."""
+
+    def __init__(self, rc, wall_time, peak_rss=None, timed_out=False):
+        self.rc = rc
+        self.wall_time = wall_time
+        # Peak RSS of the IDA process [B], None if not available.
+        self.peak_rss = peak_rss
+        self.timed_out = timed_out
+
+
+def limit_memory(limit):
+    """Returns a function which limits the address space of the calling
+    process to the given number of MB (for Popen's preexec_fn).
+    """
+    def set_limit():
+        import resource
+        size = limit * 1024 * 1024
+        resource.setrlimit(resource.RLIMIT_AS, (size, size))
+    return set_limit
+
+
+def run_process(cmd, timeout=None, cwd=None, memory_limit=None, env=None):
+    """Runs the given command, kills it after the given timeout [s]."""
+    start = time.monotonic()
+    preexec_fn = limit_memory(memory_limit) if memory_limit and not is_windows() else None
+    proc = subprocess.Popen(cmd, cwd=cwd, preexec_fn=preexec_fn, env=env)
+
+    # Windows: no wait4() -> no peak RSS.
+    if is_windows():
+        try:
+            rc = proc.wait(timeout=timeout)
+            return RunResult(rc, time.monotonic() - start)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+            return RunResult(TIMEOUT_RC, time.monotonic() - start, timed_out=True)
+
+    timed_out = False
+    while True:
+        pid, status, rusage = os.wait4(proc.pid, os.WNOHANG)
+        if pid == proc.pid:
+            break
+        if not timed_out and timeout and time.monotonic() - start > timeout:
+            os.kill(proc.pid, signal.SIGKILL)
+            timed_out = True
+        time.sleep(0.05)
+    # Let Popen know the process is gone.
+    proc.returncode = os.waitstatus_to_exitcode(status) \
+        if hasattr(os, 'waitstatus_to_exitcode') \
+        else (os.WEXITSTATUS(status) if os.WIFEXITED(status) else -os.WTERMSIG(status))
+
+    # ru_maxrss is in kB on Linux, in B on macOS.
+    peak_rss = rusage.ru_maxrss if sys.platform == 'darwin' else rusage.ru_maxrss * 1024
+    rc = TIMEOUT_RC if timed_out else proc.returncode
+    return RunResult(rc, time.monotonic() - start, peak_rss, timed_out)
+
+
+def run_decompilation(idat_path, file, idb_path=None, selected_addr=None,
+                      timeout=None, cwd=None, verbose=True, memory_limit=None,
+                      profile=''):
+    """Decompiles the given file (or IDB) by IDA in the batch mode.
+    The plugin produces "<file>.c".
+    """
+    cmd = [idat_path, '-A']
+
+    # Select mode.
+    if selected_addr:
+        cmd.append('-S' + script_selective + ' "' + file + '" ' + selected_addr)
+    # Full mode.
+    else:
+        cmd.append('-S' + script_full + ' "' + file + '"')
+
+    cmd.append(idb_path if idb_path else file)
+
+    if verbose:
+        print('RUN: ' + ' '.join(cmd))
+    env = None
+    if profile:
+        env = dict(os.environ, RETDEC_PROFILE=profile)
+    return run_process(cmd, timeout, cwd, memory_limit, env)
+
+
+def run_job(args, path, mode, addr, profile, output=None):
+    """Decompiles one job in its own working directory (IDA creates the IDB
+    next to the input, so parallel jobs must not share it). The produced C
+    file is moved to the given output, if any.
+    """
+    work_dir = tempfile.mkdtemp(prefix='retdec-job-')
+    try:
+        file = os.path.join(work_dir, os.path.basename(path))
+        shutil.copy(path, file)
+        res = run_decompilation(args.idat_path, file,
+                                selected_addr=addr if mode == 'selective' else None,
+                                timeout=args.timeout, cwd=work_dir, verbose=False,
+                                memory_limit=args.memory_limit, profile=profile)
+        out = file + '.c'
+        output_size = os.path.getsize(out) if os.path.exists(out) else 0
+        if output and output_size:
+            shutil.move(out, output)
+    finally:
+        if args.keep:
+            print('Kept:', work_dir)
+        else:
+            shutil.rmtree(work_dir, ignore_errors=True)
+
+    if res.timed_out:
+        status = 'timeout'
+    elif res.rc != 0 or output_size == 0:
+        status = 'fail'
+    else:
+        status = 'ok'
+
+    return {
+        'file': path,
+        'mode': mode,
+        'address': addr,
+        'profile': profile,
+        'status': status,
+        'rc': res.rc,
+        'wall_time': round(res.wall_time, 3),
+        'peak_rss': res.peak_rss if res.peak_rss is not None else '',
+        'output_size': output_size,
+    }
+
+
+#
+# Corpus benchmark.
+#
+
+def read_functions(path):
+    """Reads addresses from a functions side file (one per line, '#' comments)."""
+    addrs = []
+    with open(path) as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if line:
+                addrs.append(line)
+    return addrs
+
+
+def collect_corpus_jobs(corpus_dir, mode, profiles):
+    """Returns a list of (file, mode, address, profile) tuples, sorted by file."""
+    jobs = []
+    for root, dirs, files in os.walk(corpus_dir):
+        dirs.sort()
+        for name in sorted(files):
+            if name.endswith(corpus_ignored_suffixes):
+                continue
+            path = os.path.join(root, name)
+            if mode in ('full', 'both'):
+                jobs.extend((path, 'full', '', p) for p in profiles)
+            functions = path + functions_suffix
+            if mode in ('selective', 'both') and os.path.isfile(functions):
+                for addr in read_functions(functions):
+                    jobs.extend((path, 'selective', addr, p) for p in profiles)
+    return jobs
+
+
+def run_corpus_job(args, job):
+    path, mode, addr, profile = job
+    r = run_job(args, path, mode, addr, profile)
+    r['file'] = os.path.relpath(path, args.corpus_dir)
+    return r
+
+
+def summarize(results, wall_time=None):
+    """Aggregated statistics of report rows."""
+    times = [float(r['wall_time']) for r in results]
+    rss = [int(r['peak_rss']) for r in results if r['peak_rss'] not in ('', None)]
+    summary = {
+        'jobs': len(results),
+        'ok': sum(1 for r in results if r['status'] == 'ok'),
+        'fail': sum(1 for r in results if r['status'] == 'fail'),
+        'timeout': sum(1 for r in results if r['status'] == 'timeout'),
+        'total_time': round(sum(times), 3),
+        'median_time': round(statistics.median(times), 3) if times else 0,
+        'max_peak_rss': max(rss) if rss else '',
+        'output_size': sum(int(r['output_size']) for r in results),
+    }
+    if wall_time is not None:
+        summary['wall_time'] = round(wall_time, 3)
+        summary['throughput'] = round(len(results) / wall_time, 4) if wall_time else 0
+    return summary
+
+
+def write_report(path, results, summary, args):
+    if path.endswith('.json'):
+        with open(path, 'w') as f:
+            json.dump({
+                'input': os.path.abspath(args.corpus_dir or args.batch),
+                'mode': args.mode if args.corpus_dir else 'batch',
+                'profiles': args.profiles,
+                'jobs': args.jobs,
+                'timeout': args.timeout,
+                'memory_limit': args.memory_limit,
+                'summary': summary,
+                'results': results,
+            }, f, indent=4)
+    else:
+        with open(path, 'w', newline='') as f:
+            extra = [k for k in results[0] if k not in report_fields] if results else []
+            writer = csv.DictWriter(f, fieldnames=report_fields + extra)
+            writer.writeheader()
+            writer.writerows(results)
+
+
+def read_report(path):
+    """Returns the report rows (dicts with report_fields keys)."""
+    if path.endswith('.json'):
+        with open(path) as f:
+            return json.load(f)['results']
+    with open(path, newline='') as f:
+        return list(csv.DictReader(f))
+
+
+def print_summary(summary):
+    for k, v in summary.items():
+        print('  %-13s %s' % (k + ':', v))
+
+
+def run_corpus(args):
+    check_corpus_args(args)
+
+    jobs = collect_corpus_jobs(args.corpus_dir, args.mode, args.profiles)
+    if not jobs:
+        print_error_and_die('No decompilation jobs in corpus:', args.corpus_dir)
+    print('Corpus: %d jobs, %d workers' % (len(jobs), args.jobs))
+
+    results = []
+    start = time.monotonic()
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        futures = {executor.submit(run_corpus_job, args, job): job for job in jobs}
+        for i, future in enumerate(concurrent.futures.as_completed(futures), 1):
+            r = future.result()
+            results.append(r)
+            print('[%d/%d] %-7s %6.2fs %s %s %s %s' % (
+                i, len(jobs), r['status'], r['wall_time'],
+                r['mode'], r['file'], r['address'], r['profile']))
+    wall_time = time.monotonic() - start
+
+    # Reports are sorted to be diffable.
+    results.sort(key=report_key)
+    summary = summarize(results, wall_time)
+    write_report(args.report, results, summary, args)
+
+    print('Summary:')
+    print_summary(summary)
+    if len(args.profiles) > 1:
+        for p in args.profiles:
+            print('Profile %s:' % (p or '<base>'))
+            print_summary(summarize([r for r in results if r['profile'] == p]))
+    print('Report:', args.report)
+    return 0 if summary['ok'] == summary['jobs'] else 1
+
+
+def report_key(r):
+    # Reports written before profiles were added have no profile column.
+    return (r['file'], r['mode'], r['address'], r.get('profile') or '')
+
+
+def compare_reports(old_path, new_path):
+    old_rows = read_report(old_path)
+    new_rows = read_report(new_path)
+
+    # Reports with one profile each (e.g. "interactive" vs. "thorough") are
+    # compared job by job, regardless of the profile.
+    def key(r):
+        k = report_key(r)
+        return k if multi_profile else k[:3] + ('',)
+    multi_profile = any(len({report_key(r)[3] for r in rows}) > 1
+                        for rows in (old_rows, new_rows))
+    old = {key(r): r for r in old_rows}
+    new = {key(r): r for r in new_rows}
+    common = sorted(set(old) & set(new))
+
+    print('%-40s %-9s %10s %10s %8s  %s' % ('job', 'mode', 'old [s]', 'new [s]', 'ratio', 'status'))
+    ratios = []
+    for key in common:
+        o, n = old[key], new[key]
+        ot, nt = float(o['wall_time']), float(n['wall_time'])
+        ratio = nt / ot if ot else float('inf')
+        if o['status'] == 'ok' and n['status'] == 'ok' and ot:
+            ratios.append(ratio)
+        status = o['status'] if o['status'] == n['status'] else o['status'] + ' -> ' + n['status']
+        job = key[0] + (' @ ' + key[2] if key[2] else '') + (' [' + key[3] + ']' if key[3] else '')
+        print('%-40s %-9s %10.3f %10.3f %8.3f  %s' % (job, key[1], ot, nt, ratio, status))
+
+    for key in sorted(set(old) - set(new)):
+        print('Only in %s: %s %s %s %s' % (old_path, *key))
+    for key in sorted(set(new) - set(old)):
+        print('Only in %s: %s %s %s %s' % (new_path, *key))
+
+    print()
+    so = summarize([old[k] for k in common])
+    sn = summarize([new[k] for k in common])
+    print('%-13s %14s %14s' % ('', 'old', 'new'))
+    for k in so:
+        print('%-13s %14s %14s' % (k + ':', so[k], sn[k]))
+    if ratios:
+        print('Median new/old time ratio of jobs OK in both: %.3f' % statistics.median(ratios))
+    return 0
+
+
+#
+# Batch decompilation.
+#
+
+def read_manifest(path):
+    """Returns a list of (file, [address, ...]) pairs."""
+    base = os.path.dirname(os.path.abspath(path))
+    entries = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            items = line.split('#', 1)[0].split()
+            if not items:
+                continue
+            file = os.path.join(base, items[0])
+            if not os.path.isfile(file):
+                print_error_and_die('%s:%d: file does not exist: %s' % (path, lineno, file))
+            entries.append((file, items[1:]))
+    return entries
+
+
+def sha256_file(path):
+    h = hashlib.sha256()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1024 * 1024), b''):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def batch_job_path(args, sha, mode, addr):
+    """Path (without suffix) of the stored result of the given job."""
+    name = mode if mode == 'full' else mode + '-' + addr
+    if args.profile:
+        name += '@' + args.profile
+    return os.path.join(args.results_dir, sha[:2], sha, name)
+
+
+def load_batch_result(args, sha, mode, addr):
+    """Returns the stored result of the given job, or None."""
+    path = batch_job_path(args, sha, mode, addr) + batch_result_suffix
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def run_batch_job(args, job):
+    """Decompiles one batch job and stores its result. The result record is
+    written last and atomically - a job interrupted before that is re-run
+    when the batch is resumed.
+    """
+    path, sha, mode, addr = job
+    base = batch_job_path(args, sha, mode, addr)
+    os.makedirs(os.path.dirname(base), exist_ok=True)
+
+    r = run_job(args, path, mode, addr, args.profile, output=base + '.c')
+    r['sha256'] = sha
+    r['cached'] = False
+
+    tmp = base + batch_result_suffix + '.tmp'
+    with open(tmp, 'w') as f:
+        json.dump(r, f, indent=4)
+    os.replace(tmp, base + batch_result_suffix)
+    return r
+
+
+def run_batch(args):
+    check_batch_args(args)
+
+    # Identical samples (and addresses) are decompiled only once.
+    jobs = {}
+    for file, addrs in read_manifest(args.batch):
+        sha = sha256_file(file)
+        for addr in addrs or ['']:
+            mode = 'selective' if addr else 'full'
+            jobs.setdefault((sha, mode, addr), file)
+
+    results = []
+    todo = []
+    for (sha, mode, addr), file in jobs.items():
+        r = load_batch_result(args, sha, mode, addr)
+        if r is not None and (r['status'] == 'ok' or not args.retry_failed):
+            r['file'] = file
+            r['cached'] = True
+            results.append(r)
+        else:
+            todo.append((file, sha, mode, addr))
+    print('Batch: %d jobs, %d stored, %d to run, %d workers' % (
+        len(jobs), len(results), len(todo), args.jobs))
+
+    start = time.monotonic()
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        futures = [executor.submit(run_batch_job, args, job) for job in todo]
+        for i, future in enumerate(concurrent.futures.as_completed(futures), 1):
+            r = future.result()
+            results.append(r)
+            print('[%d/%d] %-7s %6.2fs %s %s %s' % (
+                i, len(todo), r['status'], r['wall_time'],
+                r['mode'], r['file'], r['address']))
+    wall_time = time.monotonic() - start
+
+    results.sort(key=report_key)
+    summary = summarize(results, wall_time)
+    summary['cached'] = sum(1 for r in results if r['cached'])
+    # Stored results took no time.
+    summary['throughput'] = round(len(todo) / wall_time, 4) if wall_time else 0
+    if args.report:
+        write_report(args.report, results, summary, args)
+        print('Report:', args.report)
+
+    print('Summary:')
+    print_summary(summary)
+    print('Results:', args.results_dir)
+    return 0 if summary['ok'] == summary['jobs'] else 1
+
+
 def main():
     args = parse_args(sys.argv[1:])
+
+    if args.compare:
+        return compare_reports(*args.compare)
+    if args.batch:
+        return run_batch(args)
+    if args.corpus_dir:
+        return run_corpus(args)
+
     check_args(args)
 
     if args.file_dir != args.output_dir:
         shutil.copy(args.file, args.output_dir)
         args.file = os.path.join(args.output_dir, os.path.basename(args.file))
-        ida_in = args.file
     if args.idb_path and os.path.dirname(args.idb_path) != args.output_dir:
         shutil.copy(args.idb_path, args.output_dir)
         args.idb_path = os.path.join(args.output_dir, os.path.basename(args.idb_path))
-        ida_in = args.idb_path
-
-    rc = 0
-    cmd = [args.idat_path, '-A']
-
-    # Select mode.
-    if args.selected_addr:
-        cmd.append('-S' + script_selective + ' "' + args.file + '" ' + args.selected_addr)
-    # Full mode.
-    else:
-        cmd.append('-S' + script_full + ' "' + args.file + '"')
-
-    #cmd.append(args.file)
-    cmd.append(ida_in)
 
-    print('RUN: ' + ' '.join(cmd))
-    rc = subprocess.call(cmd)
+    res = run_decompilation(args.idat_path, args.file, args.idb_path,
+                            args.selected_addr, args.timeout,
+                            memory_limit=args.memory_limit, profile=args.profile)
+    if res.timed_out:
+        print('Decompilation timed out after %.1f s.' % res.wall_time)
 
     # Plugin produces "<input>.c" -> copy the file to the desired output.
     out = args.file + '.c'
     if os.path.exists(out) and out != args.output:
         shutil.copyfile(out, args.output)
 
-    return rc
+    return res.rc
 
 
 if __name__ == "__main__":
-    main()
+    sys.exit(main())
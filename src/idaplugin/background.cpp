@@ -0,0 +1,148 @@
+
+#include <algorithm>
+
+#include <retdec/retdec/retdec.h>
+
+#include "background.h"
+#include "watchdog.h"
+#include "worker.h"
+
+std::mutex& decompilerMutex()
+{
+	static std::mutex m;
+	return m;
+}
+
+BackgroundDecompiler::~BackgroundDecompiler()
+{
+	stop();
+}
+
+unsigned BackgroundDecompiler::submit(
+		ea_t ea,
+		const retdec::config::Config& config)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_queue.erase(
+			std::remove_if(_queue.begin(), _queue.end(),
+					[ea](const BackgroundJob& j) { return j.ea == ea; }),
+			_queue.end()
+	);
+
+	BackgroundJob job;
+	job.ea = ea;
+	job.id = ++_lastId;
+	job.config = config;
+	_queue.push_back(std::move(job));
+
+	_stop = false;
+	if (_threads.size() < _maxThreads)
+	{
+		_threads.emplace_back(&BackgroundDecompiler::run, this);
+	}
+	_cv.notify_one();
+
+	return _lastId;
+}
+
+std::vector<BackgroundJob> BackgroundDecompiler::takeFinished()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::vector<BackgroundJob> ret;
+	ret.swap(_finished);
+	return ret;
+}
+
+void BackgroundDecompiler::setThreads(unsigned threads)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_maxThreads = std::max(threads, 1u);
+}
+
+bool BackgroundDecompiler::idle() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _queue.empty() && _running == 0 && _finished.empty();
+}
+
+void BackgroundDecompiler::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.clear();
+		_stop = true;
+	}
+	_cv.notify_all();
+	for (auto& t : _threads)
+	{
+		t.join();
+	}
+	_threads.clear();
+}
+
+void BackgroundDecompiler::run()
+{
+	while (true)
+	{
+		BackgroundJob job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cv.wait(lock, [this]() { return _stop || !_queue.empty(); });
+			if (_stop)
+			{
+				return;
+			}
+			job = std::move(_queue.front());
+			_queue.pop_front();
+			++_running;
+		}
+
+		// stop() abandons the running decompilation - at the next pass
+		// in-process, or by killing the worker.
+		Watchdog watchdog(0, 0);
+		watchdog.setPasses(job.config.parameters.llvmPasses);
+		watchdog.setProgressCallback([this](const std::string&, unsigned, unsigned)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _stop;
+		});
+		job.config.parameters.llvmPasses = Watchdog::instrument(
+				job.config.parameters.llvmPasses
+		);
+
+		try
+		{
+			if (decompilerWorker().isEnabled())
+			{
+				decompilerWorker().decompile(job.config, &job.output, job.error);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> decompilerLock(decompilerMutex());
+				auto rc = retdec::decompile(job.config, &job.output);
+				if (rc != 0)
+				{
+					job.error = "decompilation error code = "
+							+ std::to_string(rc);
+				}
+			}
+		}
+		catch (const std::exception& e)
+		{
+			job.error = e.what();
+		}
+		catch (...)
+		{
+			job.error = "unknown";
+		}
+		if (watchdog.isCancelled())
+		{
+			job.error = watchdog.getReason();
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_finished.push_back(std::move(job));
+		--_running;
+	}
+}
@@ -0,0 +1,80 @@
+
+#ifndef RETDEC_BACKGROUND_H
+#define RETDEC_BACKGROUND_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+#include "utils.h"
+
+/**
+ * RetDec (and LLVM passes it runs) keeps global state and must not run two
+ * decompilations at once. Every retdec::decompile() call - in the main
+ * thread or in the background - must hold this mutex. Decompilations in
+ * the worker processes (see worker.h) do not need it.
+ */
+std::mutex& decompilerMutex();
+
+/**
+ * One decompilation of a function running in the background.
+ */
+struct BackgroundJob
+{
+	/// Start of the decompiled function.
+	ea_t ea = BADADDR;
+	/// Newer jobs of the same function supersede the older ones.
+	unsigned id = 0;
+	retdec::config::Config config;
+	/// JSON output of the decompilation.
+	std::string output;
+	/// Error message if the decompilation failed.
+	std::string error;
+};
+
+/**
+ * Runs decompilations in background threads. There is one thread by
+ * default - in-process decompilations cannot run concurrently anyway.
+ *
+ * The threads must not touch IDA's API - jobs are submitted with complete
+ * configs, and the finished ones are taken and processed by the main thread.
+ */
+class BackgroundDecompiler
+{
+	public:
+		~BackgroundDecompiler();
+
+		/// Number of threads used by the following submit()s.
+		void setThreads(unsigned threads);
+		/// Queue decompilation of the function starting at \p ea.
+		/// Still queued jobs of the same function are dropped.
+		/// Returns the ID of the new job.
+		unsigned submit(ea_t ea, const retdec::config::Config& config);
+		/// Move out all the finished jobs.
+		std::vector<BackgroundJob> takeFinished();
+		/// No job is queued, running, or waiting to be taken.
+		bool idle() const;
+		/// Drop the queued jobs, cancel the running ones, and wait for them.
+		void stop();
+
+	private:
+		void run();
+
+	private:
+		std::vector<std::thread> _threads;
+		unsigned _maxThreads = 1;
+		mutable std::mutex _mutex;
+		std::condition_variable _cv;
+		std::deque<BackgroundJob> _queue;
+		std::vector<BackgroundJob> _finished;
+		unsigned _running = 0;
+		bool _stop = false;
+		unsigned _lastId = 0;
+};
+
+#endif
@@ -1,7 +1,11 @@
 
+#include <set>
+
 #include <retdec/utils/binary_path.h>
 
 #include "config.h"
+#include "profiler.h"
+#include "profiles.h"
 #include "retdec.h"
 #include "utils.h"
 
@@ -173,8 +177,26 @@ bool canDecompileInput(
 	return true;
 }
 
-bool generateHeader(retdec::config::Config& config, std::string out)
+bool generateHeader(
+		retdec::config::Config& config,
+		std::string out,
+		const std::string& profile)
 {
+	const Profile* p = nullptr;
+	if (!profile.empty())
+	{
+		auto it = RetDec::profiles.find(profile);
+		if (it == RetDec::profiles.end())
+		{
+			WARNING_GUI("Unknown decompilation profile: " << profile << "\n"
+					<< "Available profiles: "
+					<< profileNames(RetDec::profiles)
+			);
+			return true;
+		}
+		p = &it->second;
+	}
+
 	auto inFile = getInputPath();
 	if (inFile.empty())
 	{
@@ -206,7 +228,10 @@ bool generateHeader(retdec::config::Config& config, std::string out)
 	configPath.append("decompiler-config.json");
 	if (fs::exists(configPath))
 	{
-		config = retdec::config::Config::fromFile(configPath.string());
+		if (loadConfig(configPath.string(), p, config))
+		{
+			return true;
+		}
 		config.parameters.fixRelativePaths(idaPath.string());
 	}
 
@@ -842,20 +867,61 @@ void generateGlobals(
 	}
 }
 
-bool fillConfig(retdec::config::Config& config, const std::string& out)
+bool fillConfig(
+		retdec::config::Config& config,
+		const std::string& out,
+		const std::string& profile)
 {
+	ProfilerPhase phase("config");
 	std::map<tinfo_t, std::string> structIdSet;
 
 	config.structures.clear();
 	config.functions.clear();
 	config.globals.clear();
 
-	if (generateHeader(config, out))
 	{
-		return true;
+		ProfilerPhase phase("config.header");
+		if (generateHeader(config, out, profile))
+		{
+			return true;
+		}
+	}
+	{
+		ProfilerPhase phase("config.functions");
+		generateFunctions(config, structIdSet);
 	}
-	generateFunctions(config, structIdSet);
-	generateGlobals(config, structIdSet);
+	{
+		ProfilerPhase phase("config.globals");
+		generateGlobals(config, structIdSet);
+	}
+
+	return false;
+}
 
+bool reconfigure(retdec::config::Config& config, const std::string& profile)
+{
+	retdec::config::Config c;
+	if (generateHeader(c, config.parameters.getOutputFile(), profile))
+	{
+		return true;
+	}
+	c.structures = std::move(config.structures);
+	c.functions = std::move(config.functions);
+	c.globals = std::move(config.globals);
+	config = std::move(c);
 	return false;
 }
+
+std::vector<std::string> getPreviewPasses(const std::vector<std::string>& passes)
+{
+	std::vector<std::string> ret;
+	std::set<std::string> seen;
+	for (auto& p : passes)
+	{
+		if (p.compare(0, 7, "retdec-") == 0 || seen.insert(p).second)
+		{
+			ret.push_back(p);
+		}
+	}
+	return ret;
+}
@@ -2,11 +2,32 @@
 #ifndef RETDEC_CONFIG_H
 #define RETDEC_CONFIG_H
 
+#include <string>
+#include <vector>
+
 #include <retdec/config/config.h>
 
 /**
  * Returns \c true if something went wrong.
  */
-bool fillConfig(retdec::config::Config& config, const std::string& out = "");
+bool fillConfig(
+		retdec::config::Config& config,
+		const std::string& out = "",
+		const std::string& profile = ""
+);
+
+/**
+ * Regenerate decompilation parameters of \p config for \p profile,
+ * keep the generated functions, globals, and structures.
+ * Returns \c true if something went wrong.
+ */
+bool reconfigure(retdec::config::Config& config, const std::string& profile);
+
+/**
+ * Reduced "preview" pass list made from the full one - all RetDec passes
+ * are kept (their analyses depend on each other and on the order), but
+ * generic LLVM passes run only once, at their first position.
+ */
+std::vector<std::string> getPreviewPasses(const std::vector<std::string>& passes);
 
 #endif
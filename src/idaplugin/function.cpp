@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <sstream>
 
 #include "function.h"
@@ -11,26 +12,50 @@ Function::Function()
 Function::Function(func_t* f, const std::vector<Token>& tokens)
 		: _fnc(f)
 {
-	std::size_t y = YX::starting_y;
-	std::size_t x = YX::starting_x;
+	YX yx;
 	for (auto& t : tokens)
 	{
-		_tokens[YX(y, x)] = t;
+		append(t.kind, t.ea, t.value, yx);
+	}
+}
 
-		if (_ea2yx.count(t.ea) == 0)
+void Function::append(
+		Token::Kind kind,
+		ea_t ea,
+		const std::string& value,
+		YX& yx)
+{
+	// A token after an empty one has the same YX and replaces it.
+	if (!_tokens.empty() && _tokens.rbegin()->first == yx)
+	{
+		auto& old = _tokens.rbegin()->second;
+		if (isIdentifier(old.kind))
 		{
-			_ea2yx[t.ea] = YX(y, x);
+			auto it = _occurrences.find(symbolKey(old.kind, old.value));
+			it->second.pop_back();
+			if (it->second.empty())
+			{
+				_occurrences.erase(it);
+			}
 		}
+	}
+	// Tokens come in the YX order -> constant-time insertion at the end.
+	_tokens.insert_or_assign(_tokens.end(), yx, Token(kind, ea, value));
+	// Keeps the first YX of the address.
+	_ea2yx.emplace(ea, yx);
+	if (isIdentifier(kind))
+	{
+		_occurrences[symbolKey(kind, value)].push_back(yx);
+	}
 
-		if (t.kind == Token::Kind::NEW_LINE)
-		{
-			++y;
-			x = YX::starting_x;
-		}
-		else
-		{
-			x += t.value.size();
-		}
+	if (kind == Token::Kind::NEW_LINE)
+	{
+		++yx.y;
+		yx.x = YX::starting_x;
+	}
+	else
+	{
+		yx.x += value.size();
 	}
 }
 
@@ -187,6 +212,71 @@ bool Function::ea_inside(ea_t ea) const
 	return getStart() <= ea && ea < getEnd();
 }
 
+bool Function::isIdentifier(Token::Kind kind)
+{
+	switch (kind)
+	{
+		case Token::Kind::ID_GVAR:
+		case Token::Kind::ID_LVAR:
+		case Token::Kind::ID_MEM:
+		case Token::Kind::ID_LAB:
+		case Token::Kind::ID_FNC:
+		case Token::Kind::ID_ARG:
+			return true;
+		default:
+			return false;
+	}
+}
+
+const std::vector<YX>& Function::getOccurrences(
+		Token::Kind kind,
+		const std::string& value) const
+{
+	static const std::vector<YX> none;
+	if (!isIdentifier(kind))
+	{
+		return none;
+	}
+	auto it = _occurrences.find(symbolKey(kind, value));
+	return it == _occurrences.end() ? none : it->second;
+}
+
+YX Function::next_occurrence(YX yx) const
+{
+	yx = adjust_yx(yx);
+	auto* t = getToken(yx);
+	if (t == nullptr)
+	{
+		return yx;
+	}
+	auto& occ = getOccurrences(t->kind, t->value);
+	if (occ.empty())
+	{
+		return yx;
+	}
+
+	auto it = std::upper_bound(occ.begin(), occ.end(), yx);
+	return it == occ.end() ? occ.front() : *it;
+}
+
+YX Function::prev_occurrence(YX yx) const
+{
+	yx = adjust_yx(yx);
+	auto* t = getToken(yx);
+	if (t == nullptr)
+	{
+		return yx;
+	}
+	auto& occ = getOccurrences(t->kind, t->value);
+	if (occ.empty())
+	{
+		return yx;
+	}
+
+	auto it = std::lower_bound(occ.begin(), occ.end(), yx);
+	return it == occ.begin() ? occ.back() : *(--it);
+}
+
 std::vector<std::pair<std::string, ea_t>> Function::toLines() const
 {
 	std::vector<std::pair<std::string, ea_t>> lines;
@@ -229,3 +319,27 @@ std::ostream& operator<<(std::ostream& os, const Function& f)
 			<< "," << f.getEnd() << ")";
 	return os;
 }
+
+FunctionBuilder::FunctionBuilder(func_t* f)
+{
+	_fnc._fnc = f;
+}
+
+void FunctionBuilder::token(
+		Token::Kind kind,
+		ea_t ea,
+		const std::string& value)
+{
+	_fnc.append(kind, ea, value, _yx);
+}
+
+std::size_t FunctionBuilder::size() const
+{
+	return _fnc._tokens.size();
+}
+
+Function FunctionBuilder::take()
+{
+	_yx = YX();
+	return std::move(_fnc);
+}
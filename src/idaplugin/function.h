@@ -5,6 +5,7 @@
 #include <iostream>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "token.h"
@@ -52,17 +53,71 @@ class Function
 		/// Is address inside this function?
 		bool ea_inside(ea_t ea) const;
 
+		/// Is the token an identifier, i.e. are its occurrences indexed?
+		static bool isIdentifier(Token::Kind kind);
+		/// YXs of all the identifiers with the given kind and value, in
+		/// the YX order. Empty for the other tokens.
+		const std::vector<YX>& getOccurrences(
+				Token::Kind kind,
+				const std::string& value
+		) const;
+		/// YX of the next occurrence of the identifier at the given YX,
+		/// wraps around. The given YX if it is not an identifier.
+		YX next_occurrence(YX yx) const;
+		/// YX of the previous occurrence of the identifier at the given YX,
+		/// wraps around. The given YX if it is not an identifier.
+		YX prev_occurrence(YX yx) const;
+
 		/// Lines with associated addresses.
 		std::vector<std::pair<std::string, ea_t>> toLines() const;
 		std::string toString() const;
 		friend std::ostream& operator<<(std::ostream& os, const Function& f);
 
+	private:
+		friend class FunctionBuilder;
+		/// Append the token at \p yx, move \p yx after it.
+		void append(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value,
+				YX& yx
+		);
+
 	private:
 		func_t* _fnc = nullptr;
 		std::map<YX, Token> _tokens;
 		/// Multiple YXs can be associated with the same address.
 		/// This stores the first such XY.
 		std::map<ea_t, YX> _ea2yx;
+		/// Identifier (kind + value) -> its YXs, built as the tokens are
+		/// appended - occurrences are then found without scanning
+		/// the tokens.
+		std::unordered_map<std::string, std::vector<YX>> _occurrences;
+};
+
+/**
+ * Builds a Function from the tokens as they are parsed (see parseTokens()),
+ * i.e. without an intermediate vector of tokens.
+ */
+class FunctionBuilder : public TokenSink
+{
+	public:
+		FunctionBuilder(func_t* f);
+
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value
+		) override;
+
+		/// Number of the tokens so far.
+		std::size_t size() const;
+		/// Move out the built function.
+		Function take();
+
+	private:
+		Function _fnc;
+		YX _yx;
 };
 
 #endif
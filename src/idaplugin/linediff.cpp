@@ -0,0 +1,237 @@
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "linediff.h"
+
+namespace {
+
+const std::size_t none = SIZE_MAX;
+
+/**
+ * 64-bit FNV-1a.
+ */
+void hash(uint64_t& h, const void* data, std::size_t size)
+{
+	auto* p = static_cast<const uint8_t*>(data);
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	}
+}
+
+const uint64_t hashInit = 0xcbf29ce484222325ULL;
+
+/**
+ * Indices of the longest increasing subsequence of \p seq.
+ */
+std::vector<std::size_t> longestIncreasing(const std::vector<std::size_t>& seq)
+{
+	// Patience sorting - tops of the piles, and back pointers.
+	std::vector<std::size_t> tops;
+	std::vector<std::size_t> prev(seq.size(), none);
+	for (std::size_t i = 0; i < seq.size(); ++i)
+	{
+		auto it = std::lower_bound(
+				tops.begin(),
+				tops.end(),
+				seq[i],
+				[&seq](std::size_t t, std::size_t v) { return seq[t] < v; }
+		);
+		if (it != tops.begin())
+		{
+			prev[i] = *(it - 1);
+		}
+		if (it == tops.end())
+		{
+			tops.push_back(i);
+		}
+		else
+		{
+			*it = i;
+		}
+	}
+
+	std::vector<std::size_t> lis;
+	for (auto i = tops.empty() ? none : tops.back(); i != none; i = prev[i])
+	{
+		lis.push_back(i);
+	}
+	std::reverse(lis.begin(), lis.end());
+	return lis;
+}
+
+} // anonymous namespace
+
+std::vector<uint64_t> hashLines(const Function& f)
+{
+	std::vector<uint64_t> lines;
+	uint64_t h = hashInit;
+	bool empty = true;
+	for (auto& p : f.getTokens())
+	{
+		auto& t = p.second;
+		if (t.kind == Token::Kind::NEW_LINE)
+		{
+			lines.push_back(h);
+			h = hashInit;
+			empty = true;
+			continue;
+		}
+
+		auto kind = uint8_t(t.kind);
+		hash(h, &kind, sizeof(kind));
+		hash(h, t.value.data(), t.value.size());
+		empty = false;
+	}
+	if (!empty)
+	{
+		lines.push_back(h);
+	}
+	return lines;
+}
+
+LineDiff::LineDiff(
+		const std::vector<uint64_t>& old,
+		const std::vector<uint64_t>& now)
+		: _map(old.size(), none)
+		, _newSize(now.size())
+		, _identical(old == now)
+{
+	// Common prefix and suffix - most of the lines, usually.
+	std::size_t prefix = 0;
+	while (prefix < old.size() && prefix < now.size()
+			&& old[prefix] == now[prefix])
+	{
+		_map[prefix] = prefix;
+		++prefix;
+	}
+	std::size_t suffix = 0;
+	while (suffix < old.size() - prefix && suffix < now.size() - prefix
+			&& old[old.size() - 1 - suffix] == now[now.size() - 1 - suffix])
+	{
+		_map[old.size() - 1 - suffix] = now.size() - 1 - suffix;
+		++suffix;
+	}
+	std::size_t oldEnd = old.size() - suffix;
+	std::size_t newEnd = now.size() - suffix;
+
+	// Lines unique in both middles.
+	struct Count
+	{
+		std::size_t old = 0;
+		std::size_t now = 0;
+		std::size_t oldPos = 0;
+		std::size_t newPos = 0;
+	};
+	std::unordered_map<uint64_t, Count> counts;
+	for (std::size_t i = prefix; i < oldEnd; ++i)
+	{
+		auto& c = counts[old[i]];
+		++c.old;
+		c.oldPos = i;
+	}
+	for (std::size_t i = prefix; i < newEnd; ++i)
+	{
+		auto it = counts.find(now[i]);
+		if (it != counts.end())
+		{
+			++it->second.now;
+			it->second.newPos = i;
+		}
+	}
+	std::vector<std::pair<std::size_t, std::size_t>> unique;
+	for (auto& c : counts)
+	{
+		if (c.second.old == 1 && c.second.now == 1)
+		{
+			unique.emplace_back(c.second.oldPos, c.second.newPos);
+		}
+	}
+	std::sort(unique.begin(), unique.end());
+
+	// The biggest set of the unique lines in the same order in both.
+	std::vector<std::size_t> newPositions;
+	newPositions.reserve(unique.size());
+	for (auto& u : unique)
+	{
+		newPositions.push_back(u.second);
+	}
+	std::vector<std::pair<std::size_t, std::size_t>> anchors;
+	for (auto i : longestIncreasing(newPositions))
+	{
+		anchors.push_back(unique[i]);
+	}
+
+	// Extend the anchors to the equal lines around them, up to the previous
+	// and the next anchor.
+	std::size_t oldLo = prefix;
+	std::size_t newLo = prefix;
+	for (std::size_t a = 0; a <= anchors.size(); ++a)
+	{
+		std::size_t oldHi = a < anchors.size() ? anchors[a].first : oldEnd;
+		std::size_t newHi = a < anchors.size() ? anchors[a].second : newEnd;
+
+		// Forward from the previous anchor.
+		std::size_t o = oldLo;
+		std::size_t n = newLo;
+		while (o < oldHi && n < newHi && old[o] == now[n])
+		{
+			_map[o++] = n++;
+		}
+		// Backward from this anchor.
+		std::size_t ob = oldHi;
+		std::size_t nb = newHi;
+		while (ob > o && nb > n && old[ob - 1] == now[nb - 1])
+		{
+			--ob;
+			--nb;
+			_map[ob] = nb;
+		}
+
+		if (a < anchors.size())
+		{
+			_map[oldHi] = newHi;
+			oldLo = oldHi + 1;
+			newLo = newHi + 1;
+		}
+	}
+}
+
+bool LineDiff::identical() const
+{
+	return _identical;
+}
+
+bool LineDiff::isKept(std::size_t y) const
+{
+	auto i = y - YX::starting_y;
+	return i < _map.size() && _map[i] != none;
+}
+
+std::size_t LineDiff::map(std::size_t y) const
+{
+	if (_newSize == 0)
+	{
+		return YX::starting_y;
+	}
+
+	auto i = std::min(y - YX::starting_y, _map.size());
+	if (i < _map.size() && _map[i] != none)
+	{
+		return _map[i] + YX::starting_y;
+	}
+
+	// Right after the nearest preceding kept line.
+	std::size_t n = 0;
+	while (i > 0)
+	{
+		--i;
+		if (_map[i] != none)
+		{
+			n = _map[i] + 1;
+			break;
+		}
+	}
+	return std::min(n, _newSize - 1) + YX::starting_y;
+}
@@ -0,0 +1,48 @@
+
+#ifndef RETDEC_LINEDIFF_H
+#define RETDEC_LINEDIFF_H
+
+#include <cstdint>
+#include <vector>
+
+#include "function.h"
+
+/**
+ * Hashes of the lines of \p f - kinds and values of their tokens. The hash
+ * of line Y is at index Y - YX::starting_y.
+ */
+std::vector<uint64_t> hashLines(const Function& f);
+
+/**
+ * Maps the lines of an old version of a decompiled function to a new one,
+ * e.g. after a re-decompilation.
+ *
+ * Patience diff of the line hashes: the common prefix and suffix, then
+ * the lines unique in both versions matched in order (the longest
+ * increasing subsequence), extended to their equal neighbours. Runs in
+ * O(n log n) time and O(n) memory, even for huge functions.
+ */
+class LineDiff
+{
+	public:
+		LineDiff(
+				const std::vector<uint64_t>& old,
+				const std::vector<uint64_t>& now
+		);
+
+		/// Are the versions the same?
+		bool identical() const;
+		/// Is the old line \p y in the new version?
+		bool isKept(std::size_t y) const;
+		/// Y of the old line \p y in the new version. Changed or removed
+		/// lines are mapped right after the nearest preceding kept line.
+		std::size_t map(std::size_t y) const;
+
+	private:
+		/// Old line index -> new line index, SIZE_MAX if not kept.
+		std::vector<std::size_t> _map;
+		std::size_t _newSize = 0;
+		bool _identical = false;
+};
+
+#endif
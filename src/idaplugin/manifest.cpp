@@ -0,0 +1,238 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "manifest.h"
+#include "retdec.h"
+
+namespace {
+
+/**
+ * 64-bit FNV-1a - not cryptographic, but fast and good enough to notice
+ * changes.
+ */
+class Hash
+{
+	public:
+		void add(const void* data, std::size_t size)
+		{
+			auto* p = static_cast<const uint8_t*>(data);
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				_h = (_h ^ p[i]) * 0x100000001b3ULL;
+			}
+		}
+
+		void add(const std::string& str)
+		{
+			uint64_t size = str.size();
+			add(&size, sizeof(size));
+			add(str.data(), str.size());
+		}
+
+		void add(uint64_t val)
+		{
+			add(&val, sizeof(val));
+		}
+
+		std::string str() const
+		{
+			char buf[17];
+			std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)_h);
+			return buf;
+		}
+
+	private:
+		uint64_t _h = 0xcbf29ce484222325ULL;
+};
+
+/**
+ * Name and type of the object at \p ea, as seen by the functions
+ * referring to it.
+ */
+const std::string& describe(ea_t ea, std::map<ea_t, std::string>& cache)
+{
+	auto it = cache.find(ea);
+	if (it != cache.end())
+	{
+		return it->second;
+	}
+
+	qstring name;
+	qstring type;
+	get_name(&name, ea);
+	print_type(&type, ea, PRTYPE_1LINE);
+	return cache[ea] = std::string(name.c_str()) + '\n' + type.c_str();
+}
+
+std::string hashFunction(func_t* f, std::map<ea_t, std::string>& refs)
+{
+	Hash h;
+
+	qstring buff;
+	get_func_name(&buff, f->start_ea);
+	h.add(buff.c_str());
+	buff.clear();
+	print_type(&buff, f->start_ea, PRTYPE_1LINE);
+	h.add(buff.c_str());
+	buff.clear();
+	get_func_cmt(&buff, f, false);
+	h.add(buff.c_str());
+	h.add(uint64_t(f->flags));
+
+	std::vector<uint8_t> bytes;
+	func_tail_iterator_t fti(f);
+	for (bool ok = fti.first(); ok; ok = fti.next())
+	{
+		const range_t& r = fti.chunk();
+		bytes.resize(r.size());
+		h.add(r.start_ea);
+		h.add(r.end_ea);
+		if (!bytes.empty()
+				&& get_bytes(bytes.data(), bytes.size(), r.start_ea) > 0)
+		{
+			h.add(bytes.data(), bytes.size());
+		}
+	}
+
+	func_item_iterator_t fii;
+	for (bool ok = fii.set(f); ok; ok = fii.next_head())
+	{
+		xrefblk_t xb;
+		for (bool x = xb.first_from(fii.current(), XREF_FAR); x; x = xb.next_from())
+		{
+			if (!func_contains(f, xb.to))
+			{
+				h.add(xb.to);
+				h.add(describe(xb.to, refs));
+			}
+		}
+	}
+
+	return h.str();
+}
+
+} // anonymous namespace
+
+Manifest computeManifest(const retdec::config::Config& config)
+{
+	Manifest manifest;
+	std::map<ea_t, std::string> refs;
+
+	Hash module;
+	module.add(RetDec::pluginVersion);
+
+	for (unsigned i = 0; i < get_func_qty(); ++i)
+	{
+		func_t* f = getn_func(i);
+		manifest.functions[f->start_ea] = hashFunction(f, refs);
+	}
+
+	// Functions are hashed one by one, the rest of the config at once.
+	retdec::config::Config c = config;
+	c.functions.clear();
+	c.parameters.setOutputFile("");
+	module.add(c.generateJsonString());
+
+	manifest.module = module.str();
+	return manifest;
+}
+
+bool loadManifest(const std::string& path, Manifest& manifest)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		return true;
+	}
+	rapidjson::IStreamWrapper isw(ifs);
+	rapidjson::Document d;
+	if (d.ParseStream(isw).IsError() || !d.IsObject())
+	{
+		return true;
+	}
+
+	auto version = d.FindMember("version");
+	auto module = d.FindMember("module");
+	auto functions = d.FindMember("functions");
+	if (version == d.MemberEnd() || !version->value.IsUint()
+			|| version->value.GetUint() != manifestVersion
+			|| module == d.MemberEnd() || !module->value.IsString()
+			|| functions == d.MemberEnd() || !functions->value.IsObject())
+	{
+		return true;
+	}
+
+	manifest = Manifest();
+	manifest.module = module->value.GetString();
+	for (auto& m : functions->value.GetObject())
+	{
+		char* end = nullptr;
+		ea_t ea = std::strtoull(m.name.GetString(), &end, 16);
+		if (!m.value.IsString() || end == m.name.GetString() || *end != '\0')
+		{
+			return true;
+		}
+		manifest.functions[ea] = m.value.GetString();
+	}
+
+	return false;
+}
+
+bool saveManifest(const std::string& path, const Manifest& manifest)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("version");
+	writer.Uint(manifestVersion);
+	writer.Key("module");
+	writer.String(manifest.module.c_str());
+	writer.Key("functions");
+	writer.StartObject();
+	for (auto& f : manifest.functions)
+	{
+		std::stringstream ea;
+		ea << std::hex << "0x" << f.first;
+		writer.Key(ea.str().c_str());
+		writer.String(f.second.c_str());
+	}
+	writer.EndObject();
+	writer.EndObject();
+
+	std::ofstream ofs(path);
+	ofs << buffer.GetString();
+	return !ofs;
+}
+
+bool getChangedFunctions(
+		const Manifest& old,
+		const Manifest& now,
+		std::vector<ea_t>& changed)
+{
+	changed.clear();
+	if (old.module != now.module || old.functions.size() != now.functions.size())
+	{
+		return true;
+	}
+
+	for (auto& f : now.functions)
+	{
+		auto it = old.functions.find(f.first);
+		if (it == old.functions.end())
+		{
+			return true;
+		}
+		if (it->second != f.second)
+		{
+			changed.push_back(f.first);
+		}
+	}
+	return false;
+}
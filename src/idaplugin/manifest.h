@@ -0,0 +1,65 @@
+
+#ifndef RETDEC_MANIFEST_H
+#define RETDEC_MANIFEST_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+#include "utils.h"
+
+/**
+ * Manifest of a full decompilation - hashes of everything its output
+ * depends on. Incremental full decompilation compares it with the current
+ * state of the database and re-decompiles only the changed functions.
+ * Stored next to the output:
+ * \code{.json}
+ * {
+ *     "version": 1,
+ *     "module": "<hash>",
+ *     "functions": { "<start>": "<hash>", ... }
+ * }
+ * \endcode
+ */
+struct Manifest
+{
+	/// Plugin version, decompilation parameters, global variables, and
+	/// structures.
+	std::string module;
+	/// Function start -> bytes, name, type, and comment of the function,
+	/// and names and types of everything it refers to (e.g. callees).
+	std::map<ea_t, std::string> functions;
+};
+
+inline const unsigned manifestVersion = 1;
+
+/**
+ * Manifest of the full decompilation configured by \p config (see
+ * fillConfig()).
+ */
+Manifest computeManifest(const retdec::config::Config& config);
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool loadManifest(const std::string& path, Manifest& manifest);
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool saveManifest(const std::string& path, const Manifest& manifest);
+
+/**
+ * Starts of the functions changed between \p old and \p now.
+ * Returns \c true if everything has to be decompiled - i.e. the modules
+ * differ, or functions were added or removed.
+ */
+bool getChangedFunctions(
+		const Manifest& old,
+		const Manifest& now,
+		std::vector<ea_t>& changed
+);
+
+#endif
@@ -0,0 +1,104 @@
+
+#include <fstream>
+
+#include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
+#include <rapidjson/istreamwrapper.h>
+
+#include <retdec/utils/binary_path.h>
+#include <retdec/utils/filesystem.h>
+
+#include "options.h"
+#include "utils.h"
+
+namespace {
+
+void readBool(const rapidjson::Value& obj, const char* name, bool& out)
+{
+	auto it = obj.FindMember(name);
+	if (it != obj.MemberEnd() && it->value.IsBool())
+	{
+		out = it->value.GetBool();
+	}
+}
+
+void readUnsigned(const rapidjson::Value& obj, const char* name, unsigned& out)
+{
+	auto it = obj.FindMember(name);
+	if (it != obj.MemberEnd() && it->value.IsUint())
+	{
+		out = it->value.GetUint();
+	}
+}
+
+void readString(const rapidjson::Value& obj, const char* name, std::string& out)
+{
+	auto it = obj.FindMember(name);
+	if (it != obj.MemberEnd() && it->value.IsString())
+	{
+		out = it->value.GetString();
+	}
+}
+
+} // anonymous namespace
+
+std::string getPluginResourcePath(const std::string& name)
+{
+	auto path = retdec::utils::getThisBinaryDirectoryPath();
+	path.append("plugins");
+	path.append("retdec");
+	path.append(name);
+	return path.string();
+}
+
+bool loadOptions(Options& options)
+{
+	// E.g. set by run-ida-decompilation.py --profile.
+	qstring profile;
+	if (qgetenv("RETDEC_PROFILE", &profile))
+	{
+		options.selectiveProfile = profile.c_str();
+		options.fullProfile = profile.c_str();
+	}
+
+	auto path = getPluginResourcePath("idaplugin-config.json");
+	if (!fs::exists(path))
+	{
+		return false;
+	}
+
+	std::ifstream ifs(path);
+	rapidjson::IStreamWrapper isw(ifs);
+	rapidjson::Document d;
+	rapidjson::ParseResult ok = d.ParseStream(isw);
+	if (!ok || !d.IsObject())
+	{
+		std::string errMsg = ok ? "not an object" : GetParseError_En(ok.Code());
+		WARNING_MSG("Unable to parse plugin options " << path << ": "
+				<< errMsg << "\n"
+		);
+		return true;
+	}
+
+	readBool(d, "traceEvents", options.traceEvents);
+	readBool(d, "replayBundles", options.replayBundles);
+	readBool(d, "progressiveDecompilation", options.progressiveDecompilation);
+	if (profile.empty())
+	{
+		readString(d, "selectiveProfile", options.selectiveProfile);
+		readString(d, "fullProfile", options.fullProfile);
+	}
+	readString(d, "previewProfile", options.previewProfile);
+	readUnsigned(d, "functionTimeout", options.functionTimeout);
+	readUnsigned(d, "functionMemoryLimit", options.functionMemoryLimit);
+	readString(d, "fallbackProfile", options.fallbackProfile);
+	readBool(d, "isolatedDecompilation", options.isolatedDecompilation);
+	readUnsigned(d, "workerMemoryLimit", options.workerMemoryLimit);
+	readUnsigned(d, "workerCpuLimit", options.workerCpuLimit);
+	readUnsigned(d, "decompilationWorkers", options.decompilationWorkers);
+	readBool(d, "browsableFullDecompilation", options.browsableFullDecompilation);
+	readBool(d, "incrementalFullDecompilation", options.incrementalFullDecompilation);
+	readBool(d, "warmupDecompilation", options.warmupDecompilation);
+
+	return false;
+}
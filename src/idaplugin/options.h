@@ -0,0 +1,68 @@
+
+#ifndef RETDEC_OPTIONS_H
+#define RETDEC_OPTIONS_H
+
+#include <string>
+
+/**
+ * Plugin's own options - i.e. not the RetDec decompiler parameters, which are
+ * in "decompiler-config.json".
+ * Loaded from "plugins/retdec/idaplugin-config.json", if it exists.
+ */
+struct Options
+{
+	/// Write Chrome trace-event JSON file for every decompilation.
+	bool traceEvents = false;
+	/// Dump replay bundle (see replay.h) of every decompilation.
+	bool replayBundles = false;
+	/// Selective decompilation first shows a quick preview (decompiled
+	/// with previewProfile) and refines it in the background.
+	bool progressiveDecompilation = false;
+	/// Decompilation profiles (see profiles.h) of selective decompilation,
+	/// full decompilation, and progressive decompilation's preview.
+	/// Empty = the base "decompiler-config.json".
+	/// RETDEC_PROFILE environment variable overrides the first two.
+	std::string selectiveProfile;
+	std::string fullProfile;
+	std::string previewProfile = "interactive";
+	/// Budget of selective decompilation of one function - time [s] and
+	/// memory [MB]. 0 = unlimited. A decompilation over the budget is
+	/// cancelled and re-run with fallbackProfile (see watchdog.h).
+	unsigned functionTimeout = 0;
+	unsigned functionMemoryLimit = 0;
+	std::string fallbackProfile = "interactive";
+	/// Decompile in a forked worker process (see worker.h) with hard limits
+	/// of address space [MB] and CPU time [s]. 0 = unlimited. POSIX only.
+	/// The address space limit is on top of the one inherited from IDA
+	/// (RLIMIT_AS), enforced only where /proc is available.
+	bool isolatedDecompilation = false;
+	unsigned workerMemoryLimit = 0;
+	unsigned workerCpuLimit = 0;
+	/// Number of worker processes, i.e. of concurrent decompilations.
+	unsigned decompilationWorkers = 2;
+	/// Full decompilation also writes the tokens of the decompiled
+	/// functions into "<output>.rdtk" and opens it in the viewer (see
+	/// output.h).
+	bool browsableFullDecompilation = false;
+	/// Full decompilation re-decompiles only the functions changed since
+	/// the previous one into the same output (see manifest.h), and keeps
+	/// the rest. Implies browsableFullDecompilation.
+	bool incrementalFullDecompilation = false;
+	/// Once the autoanalysis is finished, decompile all the functions in
+	/// the background while the user is idle - entry points and exports
+	/// first, then the most referenced ones.
+	bool warmupDecompilation = false;
+};
+
+/**
+ * Path to the given file in the plugin's resource directory
+ * (i.e. "<IDA>/plugins/retdec/<name>").
+ */
+std::string getPluginResourcePath(const std::string& name);
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool loadOptions(Options& options);
+
+#endif
@@ -0,0 +1,433 @@
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include <cstring>
+
+#include "output.h"
+
+namespace {
+
+const char magic[] = {'R', 'D', 'T', 'O'};
+const std::size_t headerSize = sizeof(magic) + 1;
+/// #parts, #functions
+const std::size_t footerSize = 2 * sizeof(uint64_t);
+/// function, offset, size
+const std::size_t partSize = 3 * sizeof(uint64_t);
+/// start, part
+const std::size_t entrySize = 2 * sizeof(uint64_t);
+const uint64_t undefinedEa = UINT64_MAX;
+
+uint64_t readU64(const char* p)
+{
+	uint64_t v = 0;
+	for (unsigned i = 0; i < sizeof(v); ++i)
+	{
+		v |= uint64_t(uint8_t(p[i])) << (8 * i);
+	}
+	return v;
+}
+
+void writeU64(std::ostream& out, uint64_t v)
+{
+	char buf[sizeof(v)];
+	for (unsigned i = 0; i < sizeof(v); ++i)
+	{
+		buf[i] = char(v >> (8 * i));
+	}
+	out.write(buf, sizeof(buf));
+}
+
+} // anonymous namespace
+
+//
+//==============================================================================
+// MappedFile
+//==============================================================================
+//
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(
+			path.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+	);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return true;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return true;
+	}
+	HANDLE mapping = CreateFileMappingA(
+			file,
+			nullptr,
+			PAGE_READONLY,
+			0,
+			0,
+			nullptr
+	);
+	CloseHandle(file);
+	if (mapping == nullptr)
+	{
+		return true;
+	}
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		CloseHandle(mapping);
+		return true;
+	}
+	_mapping = mapping;
+	_data = static_cast<const char*>(data);
+	_size = size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return true;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return true;
+	}
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		return true;
+	}
+	_data = static_cast<const char*>(data);
+	_size = st.st_size;
+#endif
+
+	return false;
+}
+
+void MappedFile::close()
+{
+	if (_data == nullptr)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	UnmapViewOfFile(_data);
+	CloseHandle(_mapping);
+	_mapping = nullptr;
+#else
+	munmap(const_cast<char*>(_data), _size);
+#endif
+	_data = nullptr;
+	_size = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+	return _data != nullptr;
+}
+
+const char* MappedFile::data() const
+{
+	return _data;
+}
+
+std::size_t MappedFile::size() const
+{
+	return _size;
+}
+
+//
+//==============================================================================
+// DecompiledOutput
+//==============================================================================
+//
+
+bool DecompiledOutput::open(const std::string& path)
+{
+	close();
+	if (_file.open(path))
+	{
+		return true;
+	}
+
+	const char* data = _file.data();
+	std::size_t size = _file.size();
+	if (size < headerSize + footerSize
+			|| std::memcmp(data, magic, sizeof(magic)) != 0
+			|| uint8_t(data[sizeof(magic)]) != version)
+	{
+		close();
+		return true;
+	}
+
+	uint64_t parts = readU64(data + size - footerSize);
+	uint64_t functions = readU64(data + size - sizeof(uint64_t));
+	std::size_t available = size - headerSize - footerSize;
+	if (parts > available / partSize
+			|| functions > (available - parts * partSize) / entrySize)
+	{
+		close();
+		return true;
+	}
+	_partCount = parts;
+	_size = functions;
+	_index = data + size - footerSize - _size * entrySize;
+	_parts = _index - _partCount * partSize;
+
+	// Streams must be in the file before the parts.
+	std::size_t streams = _parts - data;
+	for (std::size_t i = 0; i < _partCount; ++i)
+	{
+		if (part(i, 1) < headerSize
+				|| part(i, 1) > streams
+				|| part(i, 2) > streams - part(i, 1))
+		{
+			close();
+			return true;
+		}
+	}
+	for (std::size_t i = 0; i < _size; ++i)
+	{
+		if (entry(i, 1) >= _partCount)
+		{
+			close();
+			return true;
+		}
+	}
+
+	_path = path;
+	return false;
+}
+
+void DecompiledOutput::close()
+{
+	_file.close();
+	_path.clear();
+	_parts = nullptr;
+	_partCount = 0;
+	_index = nullptr;
+	_size = 0;
+}
+
+bool DecompiledOutput::isOpen() const
+{
+	return _file.isOpen();
+}
+
+const std::string& DecompiledOutput::getPath() const
+{
+	return _path;
+}
+
+std::size_t DecompiledOutput::size() const
+{
+	return _size;
+}
+
+ea_t DecompiledOutput::getStart(std::size_t i) const
+{
+	return i < _size ? ea_t(entry(i, 0)) : BADADDR;
+}
+
+bool DecompiledOutput::contains(ea_t start) const
+{
+	return find(start) < _size;
+}
+
+bool DecompiledOutput::read(ea_t start, TokenSink& sink) const
+{
+	auto i = find(start);
+	if (i >= _size)
+	{
+		return true;
+	}
+
+	TokenReader reader;
+	auto p = entry(i, 1);
+	return reader.open(_file.data() + part(p, 1), part(p, 2), start)
+			|| reader.read(sink);
+}
+
+std::size_t DecompiledOutput::parts() const
+{
+	return _partCount;
+}
+
+ea_t DecompiledOutput::getPartFunction(std::size_t i) const
+{
+	uint64_t fnc = i < _partCount ? part(i, 0) : undefinedEa;
+	return fnc == undefinedEa ? BADADDR : ea_t(fnc);
+}
+
+std::size_t DecompiledOutput::getFunctionPart(ea_t start) const
+{
+	auto i = find(start);
+	return i < _size ? std::size_t(entry(i, 1)) : _partCount;
+}
+
+bool DecompiledOutput::readPart(std::size_t i, TokenSink& sink) const
+{
+	if (i >= _partCount)
+	{
+		return true;
+	}
+
+	TokenReader reader;
+	return reader.open(_file.data() + part(i, 1), part(i, 2))
+			|| reader.read(sink);
+}
+
+uint64_t DecompiledOutput::part(std::size_t i, unsigned field) const
+{
+	return readU64(_parts + i * partSize + field * sizeof(uint64_t));
+}
+
+uint64_t DecompiledOutput::entry(std::size_t i, unsigned field) const
+{
+	return readU64(_index + i * entrySize + field * sizeof(uint64_t));
+}
+
+std::size_t DecompiledOutput::find(ea_t start) const
+{
+	// Binary search right in the mapped index.
+	std::size_t lo = 0;
+	std::size_t hi = _size;
+	while (lo < hi)
+	{
+		std::size_t mid = lo + (hi - lo) / 2;
+		if (entry(mid, 0) < uint64_t(start))
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo < _size && entry(lo, 0) == uint64_t(start) ? lo : _size;
+}
+
+//
+//==============================================================================
+// OutputWriter
+//==============================================================================
+//
+
+bool OutputWriter::open(const std::string& cPath, const std::string& tokensPath)
+{
+	_c.open(cPath, std::ios::binary);
+	_tokens.open(tokensPath, std::ios::binary);
+	if (!_c || !_tokens)
+	{
+		return true;
+	}
+
+	_tokens.write(magic, sizeof(magic));
+	_tokens.put(char(DecompiledOutput::version));
+	_offset = headerSize;
+	return false;
+}
+
+void OutputWriter::token(Token::Kind kind, ea_t ea, const std::string& value)
+{
+	_c << value;
+
+	if (_lineStart)
+	{
+		func_t* f = ea != BADADDR ? get_func(ea) : nullptr;
+		ea_t fnc = f ? f->start_ea : BADADDR;
+		if (fnc != _fnc)
+		{
+			endPart();
+			_fnc = fnc;
+		}
+	}
+	_writer.token(kind, ea, value);
+	_lineStart = kind == Token::Kind::NEW_LINE;
+}
+
+void OutputWriter::endPart()
+{
+	if (_writer.size() == 0)
+	{
+		return;
+	}
+
+	Part p;
+	p.fnc = _fnc;
+	p.tokens = _writer.size();
+	auto stream = _writer.finish();
+	p.offset = _offset;
+	p.size = stream.size();
+	_tokens.write(stream.data(), stream.size());
+	_offset += stream.size();
+
+	// Parts are on the disk as soon as they are parsed.
+	_c.flush();
+	_tokens.flush();
+
+	if (p.fnc != BADADDR)
+	{
+		auto res = _index.emplace(p.fnc, _parts.size());
+		if (!res.second && p.tokens > _parts[res.first->second].tokens)
+		{
+			res.first->second = _parts.size();
+		}
+	}
+	_parts.push_back(p);
+}
+
+bool OutputWriter::close()
+{
+	endPart();
+	_fnc = BADADDR;
+	_lineStart = true;
+
+	for (auto& p : _parts)
+	{
+		writeU64(_tokens, p.fnc == BADADDR ? undefinedEa : uint64_t(p.fnc));
+		writeU64(_tokens, p.offset);
+		writeU64(_tokens, p.size);
+	}
+	for (auto& e : _index)
+	{
+		writeU64(_tokens, uint64_t(e.first));
+		writeU64(_tokens, e.second);
+	}
+	writeU64(_tokens, _parts.size());
+	writeU64(_tokens, _index.size());
+
+	_c.close();
+	_tokens.close();
+	return _c.fail() || _tokens.fail();
+}
+
+std::size_t OutputWriter::functions() const
+{
+	return _index.size();
+}
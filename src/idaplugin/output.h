@@ -0,0 +1,156 @@
+
+#ifndef RETDEC_OUTPUT_H
+#define RETDEC_OUTPUT_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "token.h"
+#include "tokenstream.h"
+
+/**
+ * Read-only memory-mapped file. Pages are read by the OS when touched,
+ * i.e. mapping even a huge file costs nothing.
+ */
+class MappedFile
+{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/// Returns \c true if something went wrong.
+		bool open(const std::string& path);
+		void close();
+		bool isOpen() const;
+
+		const char* data() const;
+		std::size_t size() const;
+
+	private:
+		const char* _data = nullptr;
+		std::size_t _size = 0;
+#ifdef _WIN32
+		void* _mapping = nullptr;
+#endif
+};
+
+/**
+ * Tokens of a full decompilation (".rdtk" file) split into parts - runs of
+ * lines belonging to one function, or to no function (e.g. global
+ * variables). Each part is a token stream (see tokenstream.h), and the
+ * functions are indexed by their start. Only the function being displayed
+ * is read, the rest of the file is not even paged in.
+ *
+ * Layout (u64 = little-endian uint64_t):
+ * \code
+ * "RDTO" u8:version
+ * token streams...                                - one per part
+ * parts: { u64:function u64:offset u64:size }...  - in the output order
+ * index: { u64:start u64:part }...                - sorted by start
+ * u64:#parts u64:#functions
+ * \endcode
+ * Parts outside of functions have the function UINT64_MAX.
+ */
+class DecompiledOutput
+{
+	public:
+		inline static const uint8_t version = 2;
+
+		/// Returns \c true if something went wrong.
+		bool open(const std::string& path);
+		void close();
+		bool isOpen() const;
+		const std::string& getPath() const;
+
+		/// Number of the functions.
+		std::size_t size() const;
+		/// Start of the \p i-th function (by address).
+		ea_t getStart(std::size_t i) const;
+		/// Is there the function starting at \p start?
+		bool contains(ea_t start) const;
+		/// Read tokens of the function starting at \p start into \p sink.
+		/// Returns \c true if something went wrong.
+		bool read(ea_t start, TokenSink& sink) const;
+
+		/// Number of the parts.
+		std::size_t parts() const;
+		/// Start of the function of the \p i-th part, BADADDR if none.
+		ea_t getPartFunction(std::size_t i) const;
+		/// Index of the biggest part of the function starting at \p start,
+		/// parts() if there is no such function.
+		std::size_t getFunctionPart(ea_t start) const;
+		/// Read tokens of the \p i-th part into \p sink.
+		/// Returns \c true if something went wrong.
+		bool readPart(std::size_t i, TokenSink& sink) const;
+
+	private:
+		uint64_t part(std::size_t i, unsigned field) const;
+		uint64_t entry(std::size_t i, unsigned field) const;
+		/// Index of the function starting at \p start, or size().
+		std::size_t find(ea_t start) const;
+
+	private:
+		MappedFile _file;
+		std::string _path;
+		const char* _parts = nullptr;
+		std::size_t _partCount = 0;
+		const char* _index = nullptr;
+		std::size_t _size = 0;
+};
+
+/**
+ * Writes the output of a full decompilation - the C source from the token
+ * values, and the tokens into ".rdtk" (see DecompiledOutput).
+ *
+ * Lines are assigned to the function containing the address of their first
+ * token. If a function has several parts (e.g. its declaration and its
+ * definition), the biggest one is indexed.
+ */
+class OutputWriter : public TokenSink
+{
+	public:
+		/// Returns \c true if something went wrong.
+		bool open(const std::string& cPath, const std::string& tokensPath);
+
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value
+		) override;
+
+		/// Write the index and close the files.
+		/// Returns \c true if something went wrong.
+		bool close();
+		/// Number of the indexed functions.
+		std::size_t functions() const;
+
+	private:
+		struct Part
+		{
+			ea_t fnc = BADADDR;
+			uint64_t offset = 0;
+			uint64_t size = 0;
+			std::size_t tokens = 0;
+		};
+
+		void endPart();
+
+	private:
+		std::ofstream _c;
+		std::ofstream _tokens;
+		uint64_t _offset = 0;
+		/// Start of the function being written, BADADDR if none.
+		ea_t _fnc = BADADDR;
+		TokenWriter _writer;
+		bool _lineStart = true;
+		std::vector<Part> _parts;
+		/// Function start -> its biggest part.
+		std::map<ea_t, std::size_t> _index;
+};
+
+#endif
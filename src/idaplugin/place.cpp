@@ -1,5 +1,8 @@
 
+#include <list>
+#include <map>
 #include <sstream>
+#include <unordered_map>
 
 #include "retdec.h"
 #include "place.h"
@@ -7,6 +10,116 @@
 static const idaplace_t _idaplace;
 static const retdec_place_t _template(nullptr, YX());
 
+namespace {
+
+/**
+ * Stands in for a function which is not decompiled yet.
+ */
+struct Placeholder
+{
+	func_t range;
+	Function fnc;
+};
+
+std::map<ea_t, Placeholder>& placeholders()
+{
+	static std::map<ea_t, Placeholder> p;
+	return p;
+}
+
+Function* placeholder(ea_t start)
+{
+	if (start == BADADDR)
+	{
+		return nullptr;
+	}
+
+	// Map nodes do not move -> the pointers stay valid.
+	auto& p = placeholders()[start];
+	if (p.fnc.fnc() == nullptr)
+	{
+		func_t* f = get_func(start);
+		p.range = f ? *f : func_t(start, start + 1);
+
+		qstring name;
+		get_func_name(&name, start);
+		std::string text = "// Decompiling "
+				+ std::string(name.empty() ? "the function" : name.c_str())
+				+ " in the background...";
+		p.fnc = Function(&p.range, {Token(Token::Kind::COMMENT, start, text)});
+	}
+	return &p.fnc;
+}
+
+/**
+ * Recent ea -> place conversions of synchronized views (see
+ * place_converter()). Scrolling a synchronized disassembly converts
+ * the same addresses over and over.
+ */
+class ConversionCache
+{
+	public:
+		bool find(ea_t ea, Function*& fnc, YX& yx)
+		{
+			auto it = _index.find(ea);
+			if (it == _index.end())
+			{
+				return false;
+			}
+			// The most recently used first.
+			_entries.splice(_entries.begin(), _entries, it->second);
+			fnc = it->second->fnc;
+			yx = it->second->yx;
+			return true;
+		}
+
+		void add(ea_t ea, Function* fnc, YX yx)
+		{
+			auto it = _index.find(ea);
+			if (it != _index.end())
+			{
+				_entries.erase(it->second);
+				_index.erase(it);
+			}
+			_entries.push_front({ea, fnc, yx});
+			_index[ea] = _entries.begin();
+			if (_entries.size() > capacity)
+			{
+				_index.erase(_entries.back().ea);
+				_entries.pop_back();
+			}
+		}
+
+		void clear()
+		{
+			_entries.clear();
+			_index.clear();
+		}
+
+	private:
+		struct Entry
+		{
+			ea_t ea;
+			Function* fnc;
+			YX yx;
+		};
+
+		inline static const std::size_t capacity = 256;
+		std::list<Entry> _entries;
+		std::unordered_map<ea_t, std::list<Entry>::iterator> _index;
+};
+
+ConversionCache& conversionCache()
+{
+	static ConversionCache c;
+	return c;
+}
+
+/// Changed by every change of the decompiled functions, never 0.
+unsigned generation = 1;
+
+} // anonymous namespace
+
 void idaapi retdec_place_t::print(qstring* out_buf, void* ud) const
 {
 	qstring ea_str;
@@ -34,6 +147,7 @@ void idaapi retdec_place_t::copyfrom(const place_t* from)
 
 	lnnum = p->lnnum;
 	_fnc = p->_fnc;
+	_start = p->_start;
 	_yx = p->_yx;
 }
 
@@ -42,7 +156,8 @@ place_t* idaapi retdec_place_t::makeplace(
 		uval_t y,
 		int lnnum) const
 {
-	auto* p = new retdec_place_t(_fnc, YX(y, 0));
+	auto* p = new retdec_place_t(*this);
+	p->_yx = YX(y, 0);
 	p->lnnum = lnnum;
 	return p;
 }
@@ -56,7 +171,7 @@ int idaapi retdec_place_t::compare2(const place_t* t2, void *ud) const
 {
 	auto* p = static_cast<const retdec_place_t*>(t2);
 
-	if (_fnc == p->_fnc)
+	if (_start == p->_start)
 	{
 		if (yx() < p->yx()) return -1;
 		else if (yx() > p->yx()) return 1;
@@ -64,7 +179,7 @@ int idaapi retdec_place_t::compare2(const place_t* t2, void *ud) const
 	}
 	// I'm not sure if this can happen (i.e. places from different functions
 	// are compared), but better safe than sorry.
-	else if (_fnc->getStart() < p->_fnc->getStart())
+	else if (_start < p->_start)
 	{
 		return -1;
 	}
@@ -86,8 +201,12 @@ void idaapi retdec_place_t::adjust(void* ud)
 
 bool idaapi retdec_place_t::prev(void* ud)
 {
-	auto pyx = _fnc->prev_yx(yx());
-	if (yx() <= _fnc->min_yx() || pyx == yx())
+	if (fnc() == nullptr)
+	{
+		return false;
+	}
+	auto pyx = fnc()->prev_yx(yx());
+	if (yx() <= fnc()->min_yx() || pyx == yx())
 	{
 		return false;
 	}
@@ -97,8 +216,12 @@ bool idaapi retdec_place_t::prev(void* ud)
 
 bool idaapi retdec_place_t::next(void* ud)
 {
-	auto nyx = _fnc->next_yx(yx());
-	if (yx() >= _fnc->max_yx() || nyx == yx())
+	if (fnc() == nullptr)
+	{
+		return false;
+	}
+	auto nyx = fnc()->next_yx(yx());
+	if (yx() >= fnc()->max_yx() || nyx == yx())
 	{
 		return false;
 	}
@@ -108,12 +231,12 @@ bool idaapi retdec_place_t::next(void* ud)
 
 bool idaapi retdec_place_t::beginning(void* ud) const
 {
-	return yx() == _fnc->min_yx();
+	return fnc() == nullptr || yx() == fnc()->min_yx();
 }
 
 bool idaapi retdec_place_t::ending(void* ud) const
 {
-	return yx() == _fnc->max_yx();
+	return fnc() == nullptr || yx() == fnc()->max_yx();
 }
 
 int idaapi retdec_place_t::generate(
@@ -128,14 +251,14 @@ int idaapi retdec_place_t::generate(
 	{
 		return 0;
 	}
-	if (x() != 0)
+	if (x() != 0 || fnc() == nullptr)
 	{
 		return 0;
 	}
 
 	*out_deflnnum = 0;
 
-	std::string str = _fnc->line_yx(yx());
+	std::string str = fnc()->line_yx(yx());
 	out->push_back(str.c_str());
 	return 1;
 }
@@ -146,11 +269,12 @@ int idaapi retdec_place_t::generate(
 // place was set to lochist_entry_t.
 // However, this is also used when saving/loading IDB, and so if we store and
 // than load function pointer, we are in trouble. Instead we serialize functions
-// as their addresses and use decompiler to get an actual function pointer.
+// as their addresses, and resolve them when the place is used (see fnc()) -
+// i.e. loading an IDB does not decompile anything.
 void idaapi retdec_place_t::serialize(bytevec_t* out) const
 {
 	place_t__serialize(this, out);
-	out->pack_ea(_fnc->getStart());
+	out->pack_ea(_start);
 	out->pack_ea(y());
 	out->pack_ea(x());
 }
@@ -163,8 +287,9 @@ bool idaapi retdec_place_t::deserialize(
 	{
 		return false;
 	}
-	auto fa = unpack_ea(pptr, end);
-	_fnc = RetDec::selectiveDecompilation(fa, false);
+	_start = unpack_ea(pptr, end);
+	_fnc = nullptr;
+	_unresolved = 0;
 	auto y = unpack_ea(pptr, end);
 	auto x = unpack_ea(pptr, end);
 	_yx = YX(y, x);
@@ -183,7 +308,7 @@ const char* idaapi retdec_place_t::name() const
 
 ea_t idaapi retdec_place_t::toea() const
 {
-	return _fnc->yx_2_ea(yx());
+	return fnc() ? fnc()->yx_2_ea(yx()) : BADADDR;
 }
 
 bool idaapi retdec_place_t::rebase(const segm_move_infos_t&)
@@ -206,7 +331,8 @@ void idaapi retdec_place_t::leave(uint32) const
 int retdec_place_t::ID = -1;
 
 retdec_place_t::retdec_place_t(Function* fnc, YX yx)
-		: _fnc(fnc)
+		: _fnc(isPlaceholder(fnc) ? nullptr : fnc)
+		, _start(fnc ? fnc->getStart() : BADADDR)
 		, _yx(yx)
 {
 	lnnum = 0;
@@ -263,12 +389,39 @@ std::size_t retdec_place_t::x() const
 
 const Token* retdec_place_t::token() const
 {
-	return fnc()->getToken(yx());
+	return fnc() ? fnc()->getToken(yx()) : nullptr;
 }
 
 Function* retdec_place_t::fnc() const
 {
-	return _fnc;
+	// Called for every rendered line - failed lookups are not repeated
+	// until a function changes.
+	if (_fnc == nullptr && _unresolved != generation)
+	{
+		_fnc = RetDec::findFunction(_start);
+		_unresolved = _fnc ? 0 : generation;
+	}
+	return _fnc ? _fnc : placeholder(_start);
+}
+
+void retdec_place_t::functionsChanged()
+{
+	conversionCache().clear();
+	// Skips 0 - not looked up yet.
+	if (++generation == 0)
+	{
+		generation = 1;
+	}
+}
+
+bool retdec_place_t::isPlaceholder(const Function* f)
+{
+	if (f == nullptr)
+	{
+		return false;
+	}
+	auto it = placeholders().find(f->getStart());
+	return it != placeholders().end() && &it->second.fnc == f;
 }
 
 std::string retdec_place_t::toString() const
@@ -280,7 +433,11 @@ std::string retdec_place_t::toString() const
 
 std::ostream& operator<<(std::ostream& os, const retdec_place_t& p)
 {
-	os << *p.fnc() << p.yx();
+	if (p.fnc())
+	{
+		os << *p.fnc();
+	}
+	os << p.yx();
 	return os;
 }
 
@@ -291,42 +448,60 @@ lecvt_code_t idaapi place_converter(
 		uint32)
 {
 	// idaplace_t -> retdec_place_t
+	// Never decompiles - functions which are not decompiled yet get
+	// a placeholder, and are decompiled in the background when it is
+	// displayed (see cv_location_changed()).
 	if (src.place()->name() == std::string(_idaplace.name()))
 	{
 		auto idaEa = src.place()->toea();
 
-		auto* cur = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
-						view,
-						false, // mouse
-						nullptr, // x
-						nullptr // y
-		));
-		if (cur == nullptr)
+		Function* fnc = nullptr;
+		YX yx;
+		if (!conversionCache().find(idaEa, fnc, yx))
 		{
-			return LECVT_ERROR;
-		}
-
-		if (cur->fnc()->ea_inside(idaEa))
-		{
-			retdec_place_t p(cur->fnc(), cur->fnc()->ea_2_yx(idaEa));
-			dst->set_place(p);
-			// Set both x and y, see renderer_info_t comment in demo.cpp.
-			dst->renderer_info().pos.cy = p.y();
-			dst->renderer_info().pos.cx = p.x();
-		}
-		else if (Function* fnc = RetDec::selectiveDecompilation(idaEa, false))
-		{
-			retdec_place_t cur(fnc, fnc->ea_2_yx(idaEa));
-			dst->set_place(cur);
-			// Set both x and y, see renderer_info_t comment in demo.cpp.
-			dst->renderer_info().pos.cy = cur.y();
-			dst->renderer_info().pos.cx = cur.x();
-		}
-		else
-		{
-			return LECVT_CANCELED;
+			auto* cur = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+							view,
+							false, // mouse
+							nullptr, // x
+							nullptr // y
+			));
+			if (cur == nullptr)
+			{
+				return LECVT_ERROR;
+			}
+
+			func_t* f = nullptr;
+			if (cur->fnc()->ea_inside(idaEa)
+					&& !retdec_place_t::isPlaceholder(cur->fnc()))
+			{
+				fnc = cur->fnc();
+			}
+			else if ((f = get_func(idaEa)) != nullptr)
+			{
+				fnc = RetDec::findFunction(f->start_ea);
+			}
+			else
+			{
+				return LECVT_CANCELED;
+			}
+
+			if (fnc)
+			{
+				yx = fnc->ea_2_yx(idaEa);
+				conversionCache().add(idaEa, fnc, yx);
+			}
+			else
+			{
+				fnc = placeholder(f->start_ea);
+				yx = fnc->min_yx();
+			}
 		}
 
+		retdec_place_t p(fnc, yx);
+		dst->set_place(p);
+		// Set both x and y, see renderer_info_t comment in demo.cpp.
+		dst->renderer_info().pos.cy = p.y();
+		dst->renderer_info().pos.cx = p.x();
 		return LECVT_OK;
 	}
 	// retdec_place_t -> idaplace_t
@@ -13,6 +13,10 @@
  *
  * An object may be displayed on one or more lines. All lines of an object are
  * generated at once and kept in a linearray_t class.
+ *
+ * Places deserialized from the IDB (navigation history, bookmarks, ...) know
+ * only the start of their function. It is looked up when the place is used,
+ * and until it is decompiled, the place shows a placeholder function.
  */
 class retdec_place_t : public place_t
 {
@@ -192,7 +196,16 @@ class retdec_place_t : public place_t
 		std::size_t y() const;
 		std::size_t x() const;
 		const Token* token() const;
+		/// Function of the place - a placeholder if it is not decompiled
+		/// yet (see isPlaceholder()), \c nullptr if the place has no
+		/// function (e.g. the registered template).
 		Function* fnc() const;
+		/// Is \p f a placeholder of a function which is not decompiled yet?
+		static bool isPlaceholder(const Function* f);
+		/// The decompiled functions changed (e.g. a function was
+		/// re-decompiled) - forget the cached conversions of synchronized
+		/// views' addresses, and look the unresolved places up again.
+		static void functionsChanged();
 
 		std::string toString() const;
 		friend std::ostream& operator<<(
@@ -203,7 +216,13 @@ class retdec_place_t : public place_t
 	private:
 		inline static const char* _name = "retdec_place_t";
 
-		Function* _fnc = nullptr;
+		/// Resolved when used, see fnc().
+		mutable Function* _fnc = nullptr;
+		/// Value of the generation (see functionsChanged()) at the last
+		/// failed resolution - not looked up again until it changes.
+		mutable unsigned _unresolved = 0;
+		/// Start of the function, even if not resolved.
+		ea_t _start = BADADDR;
 		YX _yx;
 };
 
@@ -0,0 +1,704 @@
+
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+	#include <unistd.h>
+	#if defined(__APPLE__)
+		#include <mach/mach.h>
+	#endif
+#endif
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <map>
+
+#include <llvm/Pass.h>
+#include <llvm/Support/Timer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <retdec/utils/filesystem.h>
+#include <retdec/utils/time.h>
+
+#include "profiler.h"
+#include "retdec.h"
+
+namespace {
+
+thread_local Profiler* activeProfiler = nullptr;
+
+/**
+ * Accumulated times of all the LLVM pass timers in this process.
+ * Each pass instance has its own timer, but several instances may share
+ * the same name (e.g. "instcombine") -> times are summed up by names.
+ */
+std::map<std::string, PhaseStats> llvmPassTimes()
+{
+	std::map<std::string, PhaseStats> ret;
+
+	std::string buff;
+	llvm::raw_string_ostream os(buff);
+	llvm::TimerGroup::printAllJSONValues(os, "");
+	os.flush();
+
+	rapidjson::Document d;
+	d.Parse(("{" + buff + "}").c_str());
+	if (d.HasParseError() || !d.IsObject())
+	{
+		return ret;
+	}
+
+	static const std::string prefix = "time.pass.";
+	for (auto i = d.MemberBegin(), e = d.MemberEnd(); i != e; ++i)
+	{
+		std::string key = i->name.GetString();
+		auto dot = key.find_last_of('.');
+		if (key.compare(0, prefix.size(), prefix) != 0
+				|| dot == std::string::npos
+				|| dot < prefix.size()
+				|| !i->value.IsNumber())
+		{
+			continue;
+		}
+		std::string name = key.substr(prefix.size(), dot - prefix.size());
+		std::string suffix = key.substr(dot + 1);
+		double val = i->value.GetDouble();
+
+		auto& p = ret[name];
+		p.name = name;
+		if (suffix == "wall")
+		{
+			p.wallTime += val;
+		}
+		else if (suffix == "user" || suffix == "sys")
+		{
+			p.cpuTime += val;
+		}
+	}
+
+	return ret;
+}
+
+std::string profileLogPath()
+{
+	std::string idb = get_path(PATH_TYPE_IDB);
+	if (idb.empty())
+	{
+		return std::string();
+	}
+	fs::path p(idb);
+	p.replace_extension(".retdec-profile.jsonl");
+	return p.string();
+}
+
+template <typename Writer>
+void serializePhase(Writer& writer, const PhaseStats& p, bool pass)
+{
+	writer.StartObject();
+	writer.Key("name");
+	writer.String(p.name.c_str());
+	if (!pass)
+	{
+		writer.Key("depth");
+		writer.Uint(p.depth);
+		writer.Key("start");
+		writer.Double(p.start);
+	}
+	writer.Key("wall");
+	writer.Double(p.wallTime);
+	writer.Key("cpu");
+	writer.Double(p.cpuTime);
+	if (pass)
+	{
+		writer.Key("count");
+		writer.Uint(p.count);
+	}
+	else
+	{
+		writer.Key("peakRss");
+		writer.Uint64(p.peakRss);
+	}
+	writer.EndObject();
+}
+
+/**
+ * Chrome trace-event "complete" event.
+ * https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ */
+template <typename Writer>
+void serializeTraceEvent(
+		Writer& writer,
+		const PhaseStats& p,
+		const char* category,
+		unsigned tid)
+{
+	writer.StartObject();
+	writer.Key("name");
+	writer.String(p.name.c_str());
+	writer.Key("cat");
+	writer.String(category);
+	writer.Key("ph");
+	writer.String("X");
+	writer.Key("pid");
+	writer.Uint(1);
+	writer.Key("tid");
+	writer.Uint(tid);
+	writer.Key("ts");
+	writer.Double(p.start * 1.0e6);
+	writer.Key("dur");
+	writer.Double(p.wallTime * 1.0e6);
+	writer.Key("args");
+	writer.StartObject();
+	writer.Key("cpu");
+	writer.Double(p.cpuTime);
+	if (tid == 1)
+	{
+		writer.Key("peakRss");
+		writer.Uint64(p.peakRss);
+	}
+	else
+	{
+		writer.Key("count");
+		writer.Uint(p.count);
+	}
+	writer.EndObject();
+	writer.EndObject();
+}
+
+template <typename Writer>
+void serializeThreadName(Writer& writer, unsigned tid, const char* name)
+{
+	writer.StartObject();
+	writer.Key("name");
+	writer.String("thread_name");
+	writer.Key("ph");
+	writer.String("M");
+	writer.Key("pid");
+	writer.Uint(1);
+	writer.Key("tid");
+	writer.Uint(tid);
+	writer.Key("args");
+	writer.StartObject();
+	writer.Key("name");
+	writer.String(name);
+	writer.EndObject();
+	writer.EndObject();
+}
+
+std::string traceEventsPath(const std::string& kind, ea_t ea)
+{
+	std::string idb = get_path(PATH_TYPE_IDB);
+	if (idb.empty())
+	{
+		return std::string();
+	}
+	fs::path dir(idb);
+	dir.replace_extension(".retdec-traces");
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	if (ec)
+	{
+		return std::string();
+	}
+
+	char date[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y%m%d-%H%M%S", std::localtime(&now));
+
+	std::stringstream name;
+	name << date << "-" << kind;
+	if (ea != BADADDR)
+	{
+		name << "-" << std::hex << ea;
+	}
+
+	// Do not overwrite traces of several runs within the same second.
+	auto path = dir / (name.str() + ".json");
+	for (unsigned i = 1; fs::exists(path); ++i)
+	{
+		path = dir / (name.str() + "-" + std::to_string(i) + ".json");
+	}
+	return path.string();
+}
+
+} // anonymous namespace
+
+//
+//==============================================================================
+// Profiler
+//==============================================================================
+//
+
+Profiler::Profiler(const std::string& kind, ea_t ea)
+		: _kind(kind)
+		, _ea(ea)
+		, _start(std::chrono::steady_clock::now())
+{
+	if (activeProfiler == nullptr)
+	{
+		activeProfiler = this;
+		_active = true;
+	}
+}
+
+Profiler::~Profiler()
+{
+	if (!_active)
+	{
+		return;
+	}
+
+	while (!_running.empty())
+	{
+		endPhase();
+	}
+	if (_passesRunning)
+	{
+		endPasses();
+	}
+
+	activeProfiler = nullptr;
+
+	bool decompiled = !_passes.empty() || std::any_of(
+			_phases.begin(),
+			_phases.end(),
+			[](const PhaseStats& p) { return p.name == "decompile"; }
+	);
+	if (decompiled)
+	{
+		report();
+	}
+}
+
+Profiler* Profiler::current()
+{
+	return activeProfiler;
+}
+
+double Profiler::elapsed() const
+{
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - _start;
+	return d.count();
+}
+
+void Profiler::beginPhase(const std::string& name)
+{
+	PhaseStats p;
+	p.name = name;
+	p.depth = _running.size();
+	p.start = elapsed();
+
+	_running.push_back(_phases.size());
+	_runningCpu.push_back(getProcessCpuTime());
+	_phases.push_back(p);
+}
+
+void Profiler::endPhase()
+{
+	if (_running.empty())
+	{
+		return;
+	}
+
+	auto& p = _phases[_running.back()];
+	p.wallTime = elapsed() - p.start;
+	p.cpuTime = getProcessCpuTime() - _runningCpu.back();
+	p.peakRss = getProcessPeakRss();
+
+	_running.pop_back();
+	_runningCpu.pop_back();
+}
+
+void Profiler::beginPasses(const std::vector<std::string>& passList)
+{
+	_timePassesWasEnabled = llvm::TimePassesIsEnabled;
+	llvm::TimePassesIsEnabled = true;
+
+	_passList = passList;
+	_passesSnapshot.clear();
+	for (auto& p : llvmPassTimes())
+	{
+		_passesSnapshot.push_back(p.second);
+	}
+	_passesStart = elapsed();
+	_passesRunning = true;
+}
+
+void Profiler::endPasses()
+{
+	if (!_passesRunning)
+	{
+		return;
+	}
+	_passesRunning = false;
+	_passesEnd = elapsed();
+	llvm::TimePassesIsEnabled = _timePassesWasEnabled;
+
+	std::map<std::string, PhaseStats> before;
+	for (auto& p : _passesSnapshot)
+	{
+		before[p.name] = p;
+	}
+	_passesSnapshot.clear();
+
+	for (auto& p : llvmPassTimes())
+	{
+		PhaseStats s = p.second;
+		auto it = before.find(s.name);
+		if (it != before.end())
+		{
+			s.wallTime -= it->second.wallTime;
+			s.cpuTime -= it->second.cpuTime;
+		}
+		if (s.wallTime > 0.0)
+		{
+			s.count = std::count(_passList.begin(), _passList.end(), s.name);
+			_passes.push_back(s);
+		}
+	}
+
+	// Order by the first occurrence in the pass list, passes that are not
+	// listed (i.e. analyses required by the listed ones) go last.
+	auto index = [this](const std::string& name)
+	{
+		auto it = std::find(_passList.begin(), _passList.end(), name);
+		return std::distance(_passList.begin(), it);
+	};
+	std::stable_sort(_passes.begin(), _passes.end(),
+			[&index](const PhaseStats& a, const PhaseStats& b)
+			{
+				return index(a.name) < index(b.name);
+			}
+	);
+
+	// LLVM timers provide only durations. Lay the passes out one after
+	// another from the start of the pass pipeline.
+	double start = _passesStart;
+	for (auto& p : _passes)
+	{
+		p.start = start;
+		start += p.wallTime;
+	}
+}
+
+const std::string& Profiler::getKind() const
+{
+	return _kind;
+}
+
+ea_t Profiler::getEa() const
+{
+	return _ea;
+}
+
+const std::vector<PhaseStats>& Profiler::getPhases() const
+{
+	return _phases;
+}
+
+const std::vector<PhaseStats>& Profiler::getPasses() const
+{
+	return _passes;
+}
+
+void Profiler::report() const
+{
+	static const double MB = 1024.0 * 1024.0;
+
+	// Output window.
+	//
+	std::stringstream out;
+	out << "Decompilation profile (" << _kind;
+	if (_ea != BADADDR)
+	{
+		out << " @ " << std::hex << std::showbase << _ea << std::dec;
+	}
+	out << "):\n";
+	for (auto& p : _phases)
+	{
+		out << "\t" << std::string(2 * p.depth, ' ')
+				<< std::left << std::setw(24 - 2 * p.depth) << p.name
+				<< std::right << std::fixed << std::setprecision(3)
+				<< std::setw(9) << p.wallTime << " s wall"
+				<< std::setw(9) << p.cpuTime << " s cpu"
+				<< std::setw(9) << std::setprecision(1) << p.peakRss / MB
+				<< " MB peak RSS\n";
+	}
+
+	auto passes = _passes;
+	std::sort(passes.begin(), passes.end(),
+			[](const PhaseStats& a, const PhaseStats& b)
+			{
+				return a.wallTime > b.wallTime;
+			}
+	);
+	const std::size_t topPasses = 5;
+	if (passes.size() > topPasses)
+	{
+		passes.resize(topPasses);
+	}
+	if (!passes.empty())
+	{
+		out << "\tslowest LLVM passes:\n";
+	}
+	for (auto& p : passes)
+	{
+		out << "\t  " << std::left << std::setw(22) << p.name
+				<< std::right << std::fixed << std::setprecision(3)
+				<< std::setw(9) << p.wallTime << " s wall"
+				<< std::setw(9) << p.cpuTime << " s cpu\n";
+	}
+	INFO_MSG(out.str());
+
+	// JSON log - one record per line.
+	//
+	auto logPath = profileLogPath();
+	if (logPath.empty())
+	{
+		return;
+	}
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("kind");
+	writer.String(_kind.c_str());
+	writer.Key("ea");
+	writer.Uint64(_ea == BADADDR ? 0 : _ea);
+	writer.Key("date");
+	auto date = retdec::utils::getCurrentDate()
+			+ " " + retdec::utils::getCurrentTime();
+	writer.String(date.c_str());
+	writer.Key("phases");
+	writer.StartArray();
+	for (auto& p : _phases)
+	{
+		serializePhase(writer, p, false);
+	}
+	writer.EndArray();
+	if (!_passes.empty())
+	{
+		writer.Key("passes");
+		writer.StartArray();
+		for (auto& p : _passes)
+		{
+			serializePhase(writer, p, true);
+		}
+		writer.EndArray();
+	}
+	writer.EndObject();
+
+	std::ofstream log(logPath, std::ios::app);
+	if (!log)
+	{
+		WARNING_MSG("Unable to write profile log: " << logPath << "\n");
+	}
+	else
+	{
+		log << buffer.GetString() << "\n";
+	}
+
+	// Chrome trace events.
+	//
+	if (RetDec::options.traceEvents)
+	{
+		auto tracePath = traceEventsPath(_kind, _ea);
+		if (!tracePath.empty() && !writeTraceEvents(tracePath))
+		{
+			INFO_MSG("Trace events written to: " << tracePath << "\n");
+		}
+	}
+}
+
+bool Profiler::writeTraceEvents(const std::string& path) const
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("displayTimeUnit");
+	writer.String("ms");
+	writer.Key("traceEvents");
+	writer.StartArray();
+	serializeThreadName(writer, 1, "phases");
+	if (!_passes.empty())
+	{
+		serializeThreadName(writer, 2, "LLVM passes (aggregated by name)");
+	}
+	for (auto& p : _phases)
+	{
+		serializeTraceEvent(writer, p, "phase", 1);
+	}
+	for (auto& p : _passes)
+	{
+		serializeTraceEvent(writer, p, "pass", 2);
+	}
+	// Time spent in retdec::decompile() outside the timed passes - e.g.
+	// input loading, or pass manager overhead.
+	double passesTime = 0.0;
+	for (auto& p : _passes)
+	{
+		passesTime += p.wallTime;
+	}
+	if (!_passes.empty() && _passesEnd - _passesStart > passesTime)
+	{
+		PhaseStats rest;
+		rest.name = "(outside of passes)";
+		rest.start = _passesStart + passesTime;
+		rest.wallTime = _passesEnd - _passesStart - passesTime;
+		rest.count = 0;
+		serializeTraceEvent(writer, rest, "pass", 2);
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	std::ofstream out(path);
+	if (!out)
+	{
+		WARNING_MSG("Unable to write trace events: " << path << "\n");
+		return true;
+	}
+	out << buffer.GetString();
+	return false;
+}
+
+//
+//==============================================================================
+// ProfilerPhase
+//==============================================================================
+//
+
+ProfilerPhase::ProfilerPhase(const std::string& name)
+		: _profiler(Profiler::current())
+{
+	if (_profiler)
+	{
+		_profiler->beginPhase(name);
+	}
+}
+
+ProfilerPhase::~ProfilerPhase()
+{
+	if (_profiler)
+	{
+		_profiler->endPhase();
+	}
+}
+
+//
+//==============================================================================
+// ProfilerPasses
+//==============================================================================
+//
+
+ProfilerPasses::ProfilerPasses(const std::vector<std::string>& passList)
+		: _profiler(Profiler::current())
+{
+	if (_profiler)
+	{
+		_profiler->beginPasses(passList);
+	}
+}
+
+ProfilerPasses::~ProfilerPasses()
+{
+	if (_profiler)
+	{
+		_profiler->endPasses();
+	}
+}
+
+//
+//==============================================================================
+// Process resources
+//==============================================================================
+//
+
+double getProcessCpuTime()
+{
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+	{
+		return 0.0;
+	}
+	auto toSeconds = [](const FILETIME& ft)
+	{
+		ULARGE_INTEGER t;
+		t.LowPart = ft.dwLowDateTime;
+		t.HighPart = ft.dwHighDateTime;
+		return t.QuadPart / 1.0e7; // 100 ns units
+	};
+	return toSeconds(user) + toSeconds(kernel);
+#else
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+	{
+		return 0.0;
+	}
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1.0e6
+			+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1.0e6;
+#endif
+}
+
+std::size_t getProcessPeakRss()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+	{
+		return 0;
+	}
+	return pmc.PeakWorkingSetSize;
+#else
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+	{
+		return 0;
+	}
+#if defined(__APPLE__)
+	return ru.ru_maxrss; // bytes
+#else
+	return std::size_t(ru.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+std::size_t getProcessRss()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+	{
+		return 0;
+	}
+	return pmc.WorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(
+			mach_task_self(),
+			MACH_TASK_BASIC_INFO,
+			reinterpret_cast<task_info_t>(&info),
+			&count) != KERN_SUCCESS)
+	{
+		return 0;
+	}
+	return info.resident_size;
+#else
+	std::ifstream statm("/proc/self/statm");
+	std::size_t size = 0;
+	std::size_t resident = 0;
+	if (!(statm >> size >> resident))
+	{
+		return 0;
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
@@ -0,0 +1,139 @@
+
+#ifndef RETDEC_PROFILER_H
+#define RETDEC_PROFILER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+/**
+ * Resources consumed by one decompilation phase (or one LLVM pass).
+ */
+struct PhaseStats
+{
+	std::string name;
+	/// Nesting level of the phase (0 = top-level phase).
+	unsigned depth = 0;
+	/// Start of the phase relative to the start of the profiled run [s].
+	double start = 0.0;
+	/// Wall-clock time [s].
+	double wallTime = 0.0;
+	/// CPU (user + system) time [s].
+	double cpuTime = 0.0;
+	/// Peak resident set size of the whole process at the end of the phase [B].
+	std::size_t peakRss = 0;
+	/// How many times is the pass listed in the pass list.
+	unsigned count = 1;
+};
+
+/**
+ * Per-phase latency instrumentation of one decompilation run.
+ *
+ * There is at most one active profiler per thread. If a profiler is created
+ * while another one is active, it does nothing and all the phases go to the
+ * outer (active) one. Phases are recorded by ProfilerPhase objects anywhere
+ * down the call stack.
+ *
+ * The results are reported when the active profiler is destroyed, but only
+ * if there was an actual decompilation - a "decompile" phase (e.g. not for
+ * cache hits). Per-pass timings are reported only if they were collected
+ * (not e.g. for decompilations in the worker processes).
+ */
+class Profiler
+{
+	public:
+		Profiler(const std::string& kind, ea_t ea = BADADDR);
+		~Profiler();
+
+		/// Active profiler of this thread, or \c nullptr.
+		static Profiler* current();
+
+		void beginPhase(const std::string& name);
+		void endPhase();
+
+		/// Start/stop collecting timings of individual LLVM passes.
+		/// Passes are ordered by their first occurrence in \p passList.
+		void beginPasses(const std::vector<std::string>& passList);
+		void endPasses();
+
+		const std::string& getKind() const;
+		ea_t getEa() const;
+		const std::vector<PhaseStats>& getPhases() const;
+		const std::vector<PhaseStats>& getPasses() const;
+
+		/// Print a summary into the IDA's output window and append
+		/// a JSON record to the profile log next to the IDB.
+		void report() const;
+		/// Write the run as a Chrome trace-event JSON file.
+		/// Returns \c true if something went wrong.
+		bool writeTraceEvents(const std::string& path) const;
+
+	private:
+		double elapsed() const;
+
+	private:
+		bool _active = false;
+		std::string _kind;
+		ea_t _ea = BADADDR;
+		std::chrono::steady_clock::time_point _start;
+		std::vector<PhaseStats> _phases;
+		/// Indexes of the running phases in _phases.
+		std::vector<std::size_t> _running;
+		std::vector<double> _runningCpu;
+		/// LLVM pass timings.
+		bool _passesRunning = false;
+		/// llvm::TimePassesIsEnabled before beginPasses().
+		bool _timePassesWasEnabled = false;
+		double _passesStart = 0.0;
+		double _passesEnd = 0.0;
+		std::vector<std::string> _passList;
+		std::vector<PhaseStats> _passes;
+		std::vector<PhaseStats> _passesSnapshot;
+};
+
+/**
+ * Profiler phase - starts on construction and ends on destruction.
+ * Does nothing if there is no active profiler.
+ */
+class ProfilerPhase
+{
+	public:
+		ProfilerPhase(const std::string& name);
+		~ProfilerPhase();
+
+	private:
+		Profiler* _profiler = nullptr;
+};
+
+/**
+ * Collects timings of LLVM passes run during the object's lifetime.
+ * Does nothing if there is no active profiler.
+ */
+class ProfilerPasses
+{
+	public:
+		ProfilerPasses(const std::vector<std::string>& passList);
+		~ProfilerPasses();
+
+	private:
+		Profiler* _profiler = nullptr;
+};
+
+/**
+ * CPU (user + system) time consumed by this process [s].
+ */
+double getProcessCpuTime();
+
+/**
+ * Peak resident set size of this process [B].
+ */
+std::size_t getProcessPeakRss();
+
+/**
+ * Current resident set size of this process [B].
+ */
+std::size_t getProcessRss();
+
+#endif
@@ -0,0 +1,219 @@
+
+#include <fstream>
+
+#include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <retdec/utils/filesystem.h>
+
+#include "config.h"
+#include "options.h"
+#include "profiles.h"
+#include "utils.h"
+
+namespace {
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool parseJsonFile(const std::string& path, rapidjson::Document& d)
+{
+	std::ifstream ifs(path);
+	rapidjson::IStreamWrapper isw(ifs);
+	rapidjson::ParseResult ok = d.ParseStream(isw);
+	if (!ok || !d.IsObject())
+	{
+		std::string errMsg = ok ? "not an object" : GetParseError_En(ok.Code());
+		WARNING_MSG("Unable to parse " << path << ": " << errMsg << "\n");
+		return true;
+	}
+	return false;
+}
+
+std::string toJsonString(const rapidjson::Value& val)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	val.Accept(writer);
+	return buffer.GetString();
+}
+
+bool sameType(const rapidjson::Value& a, const rapidjson::Value& b)
+{
+	return (a.IsBool() && b.IsBool())
+			|| (a.IsNumber() && b.IsNumber())
+			|| (a.IsString() && b.IsString())
+			|| (a.IsArray() && b.IsArray());
+}
+
+/**
+ * Returns an error message, or an empty string if the profile is valid.
+ */
+std::string validateProfile(
+		const rapidjson::Value& profile,
+		const rapidjson::Value& baseParams,
+		Profile& out)
+{
+	if (!profile.IsObject())
+	{
+		return "not an object";
+	}
+
+	for (auto& m : profile.GetObject())
+	{
+		std::string key = m.name.GetString();
+		if (key == "description" && m.value.IsString())
+		{
+			out.description = m.value.GetString();
+		}
+		else if (key == "previewPasses" && m.value.IsBool())
+		{
+			out.previewPasses = m.value.GetBool();
+		}
+		else if (key == "decompParams" && m.value.IsObject())
+		{
+			for (auto& p : m.value.GetObject())
+			{
+				auto base = baseParams.FindMember(p.name);
+				if (base == baseParams.MemberEnd())
+				{
+					return std::string("unknown parameter \"")
+							+ p.name.GetString() + "\"";
+				}
+				if (!sameType(base->value, p.value))
+				{
+					return std::string("invalid type of parameter \"")
+							+ p.name.GetString() + "\"";
+				}
+			}
+			out.decompParams = toJsonString(m.value);
+		}
+		else
+		{
+			return "invalid member \"" + key + "\"";
+		}
+	}
+
+	return std::string();
+}
+
+} // anonymous namespace
+
+bool loadProfiles(Profiles& profiles)
+{
+	auto path = getPluginResourcePath("decompiler-profiles.json");
+	auto basePath = getPluginResourcePath("decompiler-config.json");
+	if (!fs::exists(path) || !fs::exists(basePath))
+	{
+		return false;
+	}
+
+	rapidjson::Document d;
+	rapidjson::Document base;
+	if (parseJsonFile(path, d) || parseJsonFile(basePath, base))
+	{
+		return true;
+	}
+	auto baseParams = base.FindMember("decompParams");
+	if (baseParams == base.MemberEnd() || !baseParams->value.IsObject())
+	{
+		WARNING_MSG("No \"decompParams\" in " << basePath << "\n");
+		return true;
+	}
+
+	bool ret = false;
+	for (auto& m : d.GetObject())
+	{
+		Profile p;
+		p.name = m.name.GetString();
+		auto err = validateProfile(m.value, baseParams->value, p);
+		if (!err.empty())
+		{
+			WARNING_MSG("Invalid decompilation profile \"" << p.name << "\": "
+					<< err << "\n"
+			);
+			ret = true;
+			continue;
+		}
+		profiles[p.name] = p;
+	}
+
+	return ret;
+}
+
+bool loadConfig(
+		const std::string& path,
+		const Profile* profile,
+		retdec::config::Config& config)
+{
+	try
+	{
+		if (profile == nullptr || profile->decompParams.empty())
+		{
+			config = retdec::config::Config::fromFile(path);
+		}
+		else
+		{
+			rapidjson::Document d;
+			rapidjson::Document overlay;
+			overlay.Parse(profile->decompParams.c_str());
+			if (parseJsonFile(path, d) || overlay.HasParseError())
+			{
+				return true;
+			}
+
+			auto params = d.FindMember("decompParams");
+			if (params == d.MemberEnd() || !params->value.IsObject())
+			{
+				WARNING_MSG("No \"decompParams\" in " << path << "\n");
+				return true;
+			}
+			auto& alloc = d.GetAllocator();
+			for (auto& m : overlay.GetObject())
+			{
+				rapidjson::Value val(m.value, alloc);
+				auto it = params->value.FindMember(m.name);
+				if (it != params->value.MemberEnd())
+				{
+					it->value = val;
+				}
+				else
+				{
+					rapidjson::Value name(m.name, alloc);
+					params->value.AddMember(name, val, alloc);
+				}
+			}
+
+			config = retdec::config::Config::fromJsonString(toJsonString(d));
+		}
+	}
+	catch (const std::exception& e)
+	{
+		WARNING_MSG("Unable to load decompilation config " << path << ": "
+				<< e.what() << "\n"
+		);
+		return true;
+	}
+
+	if (profile && profile->previewPasses)
+	{
+		config.parameters.llvmPasses = getPreviewPasses(
+				config.parameters.llvmPasses
+		);
+	}
+
+	return false;
+}
+
+std::string profileNames(const Profiles& profiles)
+{
+	std::string ret;
+	for (auto& p : profiles)
+	{
+		ret += (ret.empty() ? "" : ", ") + p.first;
+	}
+	return ret;
+}
@@ -0,0 +1,62 @@
+
+#ifndef RETDEC_PROFILES_H
+#define RETDEC_PROFILES_H
+
+#include <map>
+#include <string>
+
+#include <retdec/config/config.h>
+
+/**
+ * Named decompilation profile - e.g. "interactive" (the lowest latency),
+ * "batch" (balanced), or "thorough" (the best output).
+ *
+ * A profile is an overlay of "decompParams" in "decompiler-config.json".
+ * Profiles are loaded from "plugins/retdec/decompiler-profiles.json":
+ * \code{.json}
+ * {
+ *     "<name>": {
+ *         "description": "<text>",
+ *         "previewPasses": <bool>,
+ *         "decompParams": { <parameters to override> }
+ *     }
+ * }
+ * \endcode
+ */
+struct Profile
+{
+	std::string name;
+	std::string description;
+	/// Reduce the pass list (see getPreviewPasses()).
+	bool previewPasses = false;
+	/// Serialized JSON object with the "decompParams" members to override.
+	std::string decompParams;
+};
+
+using Profiles = std::map<std::string, Profile>;
+
+/**
+ * Load the profiles and validate them against "decompiler-config.json" -
+ * a profile may override only the existing parameters, and only by values
+ * of the same JSON type. Invalid profiles are reported and skipped.
+ * Returns \c true if something went wrong.
+ */
+bool loadProfiles(Profiles& profiles);
+
+/**
+ * Load the decompilation config from \p path and apply \p profile
+ * (if not \c nullptr) on it.
+ * Returns \c true if something went wrong.
+ */
+bool loadConfig(
+		const std::string& path,
+		const Profile* profile,
+		retdec::config::Config& config
+);
+
+/**
+ * Comma-separated names of all the profiles.
+ */
+std::string profileNames(const Profiles& profiles);
+
+#endif
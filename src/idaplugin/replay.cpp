@@ -0,0 +1,71 @@
+
+#include <fstream>
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+#include <retdec/utils/filesystem.h>
+
+#include "replay.h"
+
+bool writeReplayBundle(
+		const retdec::config::Config& config,
+		const std::string& name,
+		func_t* fnc)
+{
+	std::string idb = get_path(PATH_TYPE_IDB);
+	if (idb.empty())
+	{
+		return true;
+	}
+	fs::path dir(idb);
+	dir.replace_extension(".retdec-replay");
+	dir /= name;
+
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	if (ec)
+	{
+		WARNING_MSG("Unable to create replay bundle directory " << dir.string()
+				<< ": " << ec.message() << "\n"
+		);
+		return true;
+	}
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("version");
+	writer.Uint(replayBundleVersion);
+	writer.Key("inputFile");
+	writer.String(config.parameters.getInputFile().c_str());
+	if (fnc)
+	{
+		qstring qFncName;
+		get_func_name(&qFncName, fnc->start_ea);
+
+		writer.Key("function");
+		writer.StartObject();
+		writer.Key("name");
+		writer.String(qFncName.c_str());
+		writer.Key("start");
+		writer.Uint64(fnc->start_ea);
+		writer.Key("end");
+		writer.Uint64(fnc->end_ea);
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	std::ofstream info((dir / replayBundleInfo).string());
+	std::ofstream cfg((dir / replayBundleConfig).string());
+	if (!info || !cfg)
+	{
+		WARNING_MSG("Unable to write replay bundle: " << dir.string() << "\n");
+		return true;
+	}
+	info << buffer.GetString();
+	cfg << config.generateJsonString();
+
+	INFO_MSG("Replay bundle written to: " << dir.string() << "\n");
+	return false;
+}
@@ -0,0 +1,34 @@
+
+#ifndef RETDEC_REPLAY_H
+#define RETDEC_REPLAY_H
+
+#include <string>
+
+#include <retdec/config/config.h>
+
+#include "utils.h"
+
+/**
+ * Replay bundle is a directory with everything the stand-alone replay
+ * driver (retdec-replay) needs to repeat a decompilation without IDA:
+ *   - config.json - the exact generated decompilation config (including
+ *                   the input path and the selected ranges),
+ *   - bundle.json - the bundle version and the decompiled function (if any).
+ */
+inline const std::string replayBundleConfig = "config.json";
+inline const std::string replayBundleInfo   = "bundle.json";
+inline const unsigned    replayBundleVersion = 1;
+
+/**
+ * Write replay bundle of the decompilation described by \p config into
+ * "<idb>.retdec-replay/<name>" directory next to the IDB.
+ * \p fnc is the selectively decompiled function, or \c nullptr.
+ * Returns \c true if something went wrong.
+ */
+bool writeReplayBundle(
+		const retdec::config::Config& config,
+		const std::string& name,
+		func_t* fnc = nullptr
+);
+
+#endif
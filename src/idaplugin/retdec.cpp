@@ -1,12 +1,22 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include <retdec/retdec/retdec.h>
 #include <retdec/utils/binary_path.h>
 
+#include "background.h"
 #include "function.h"
 #include "config.h"
+#include "linediff.h"
+#include "manifest.h"
 #include "place.h"
+#include "profiler.h"
+#include "replay.h"
 #include "retdec.h"
 #include "ui.h"
+#include "watchdog.h"
+#include "worker.h"
 
 plugmod_t* idaapi init(void)
 {
@@ -28,7 +38,42 @@ plugin_t PLUGIN =
 };
 
 std::map<func_t*, Function> RetDec::fnc2fnc;
+DecompiledOutput RetDec::decompiledOutput;
+SearchIndex RetDec::searchIndex;
+XrefGraph RetDec::xrefGraph;
+bool RetDec::outputIndexed = false;
 retdec::config::Config RetDec::config;
+Options RetDec::options;
+Profiles RetDec::profiles;
+BackgroundDecompiler RetDec::background;
+std::map<ea_t, Refinement> RetDec::refinements;
+retdec::config::Config RetDec::backgroundConfig;
+bool RetDec::backgroundConfigValid = false;
+
+/// How often are finished background refinements picked up [ms].
+const int refinementTimerPeriod = 250;
+
+int idaapi refinementTimerCallback(void* ud)
+{
+	static_cast<RetDec*>(ud)->refineFunctions();
+	return refinementTimerPeriod;
+}
+
+/// How often does the warmup check whether IDA is idle [ms].
+const int warmupTimerPeriod = 1000;
+/// The warmup pauses until the user has not moved for this long.
+const std::chrono::seconds warmupIdleDelay(3);
+
+int idaapi warmupTimerCallback(void* ud)
+{
+	auto* plg = static_cast<RetDec*>(ud);
+	if (plg->warmup())
+	{
+		plg->warmupTimer = nullptr;
+		return -1; // unregister
+	}
+	return warmupTimerPeriod;
+}
 
 RetDec::RetDec()
 {
@@ -54,17 +99,82 @@ RetDec::RetDec()
 	{
 		ERROR_MSG("Failed to register: " << fullDecompilation_ah_t::actionName);
 	}
+	if (!register_action(openOutput_ah_desc)
+			|| !attach_action_to_menu(
+					"File/Load file/Parse C header file",
+					openOutput_ah_t::actionName,
+					SETMENU_APP))
+	{
+		ERROR_MSG("Failed to register: " << openOutput_ah_t::actionName);
+	}
+	if (!register_action(search_ah_desc)
+			|| !attach_action_to_menu(
+					"Search/Next text",
+					search_ah_t::actionName,
+					SETMENU_APP))
+	{
+		ERROR_MSG("Failed to register: " << search_ah_t::actionName);
+	}
 	register_action(jump2asm_ah_desc);
 	register_action(copy2asm_ah_desc);
+	register_action(copy2asmFunctions_ah_desc);
+	register_action(nextOccurrence_ah_desc);
+	register_action(prevOccurrence_ah_desc);
 	register_action(funcComment_ah_desc);
 	register_action(renameGlobalObj_ah_desc);
+	register_action(renameLocal_ah_desc);
 	register_action(openCalls_ah_desc);
 	register_action(openXrefs_ah_desc);
+	register_action(pseudocodeXrefs_ah_desc);
 	register_action(changeFuncType_ah_desc);
+	register_action(profileDecompilation_ah_desc);
+	register_action(backgroundDecompilation_ah_desc);
+
+	loadOptions(options);
+	loadProfiles(profiles);
+	if (options.isolatedDecompilation)
+	{
+		// Fork now, before any decompilation or background thread runs.
+		DecompilerWorker::Limits limits;
+		limits.memoryLimit = options.workerMemoryLimit;
+		limits.cpuLimit = options.workerCpuLimit;
+		if (!DecompilerWorker::isSupported())
+		{
+			WARNING_MSG("Isolated decompilation is not supported on this "
+					"system, decompiling in IDA's process.\n"
+			);
+		}
+		else if (decompilerWorker().start(limits, options.decompilationWorkers))
+		{
+			WARNING_MSG("Unable to start the decompilation workers, "
+					"decompiling in IDA's process.\n"
+			);
+			decompilerWorker().stop();
+		}
+		background.setThreads(decompilerWorker().getWorkers());
+	}
+	if (options.progressiveDecompilation)
+	{
+		refinementTimer = register_timer(
+				refinementTimerPeriod,
+				refinementTimerCallback,
+				this
+		);
+	}
+
+	if (options.warmupDecompilation)
+	{
+		warmupTimer = register_timer(
+				warmupTimerPeriod,
+				warmupTimerCallback,
+				this
+		);
+	}
 
 	retdec_place_t::registerPlace(PLUGIN);
 
 	hook_event_listener(HT_UI, this);
+	hook_event_listener(HT_IDB, &idbListener);
 
 	INFO_MSG(pluginName << " version " << pluginVersion << " loaded OK\n");
 }
@@ -73,16 +183,60 @@ bool runDecompilation(
 		retdec::config::Config& config,
 		std::string* output = nullptr)
 {
+	if (decompilerWorker().isEnabled())
+	{
+		ProfilerPhase phase("decompile");
+		std::string error;
+		if (decompilerWorker().decompile(config, output, error))
+		{
+			WARNING_GUI("Decompilation exception: " << error << std::endl);
+			return true;
+		}
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(decompilerMutex(), std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		ProfilerPhase phase("wait");
+		replace_wait_box("Waiting for the background decompilation...");
+		auto* w = Watchdog::current();
+		while (!lock.try_lock())
+		{
+			if (w && w->progress(std::string(), 0, 0))
+			{
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		replace_wait_box("Decompiling...");
+
+		// Waiting is not a part of the budget.
+		if (w)
+		{
+			w->start();
+		}
+	}
+
+	ProfilerPhase phase("decompile");
+	ProfilerPasses passes(config.parameters.llvmPasses);
+
 	try
 	{
 		auto rc = retdec::decompile(config, output);
-		if (rc != 0)
+		auto* w = Watchdog::current();
+		if (rc != 0 && !(w && w->isCancelled()))
 		{
 			throw std::runtime_error(
 					"decompilation error code = " + std::to_string(rc)
 			);
 		}
 	}
+	catch (const WatchdogCancelled&)
+	{
+		// Reported by the watchdog's owner.
+		return false;
+	}
 	catch (const std::runtime_error& e)
 	{
 		WARNING_GUI("Decompilation exception: " << e.what() << std::endl);
@@ -97,10 +251,93 @@ bool runDecompilation(
 	return false;
 }
 
+/**
+ * Make \p config decompile only the function \p f into JSON.
+ */
+void selectFunction(retdec::config::Config& config, func_t* f)
+{
+	retdec::common::AddressRange r(f->start_ea, f->end_ea);
+	config.parameters.setOutputFormat("json");
+	config.parameters.selectedRanges.insert(r);
+	config.parameters.setIsSelectedDecodeOnly(true);
+}
+
+/**
+ * Show the progress in the wait box, poll its Cancel button.
+ */
+bool waitBoxProgress(const std::string& pass, unsigned done, unsigned total)
+{
+	if (!pass.empty() && total)
+	{
+		replace_wait_box("Decompiling... %u%%\n%s",
+				done * 100 / total,
+				pass.c_str()
+		);
+	}
+	return user_cancelled();
+}
+
+/**
+ * Run the decompilation under \p watchdog - within its budget, with
+ * progress in the wait box, cancellable by the user.
+ * Returns \c true if something went wrong or the user cancelled
+ * the decompilation. If the watchdog was cancelled, the output is not valid.
+ */
+bool runWatchedDecompilation(
+		retdec::config::Config& config,
+		std::string* output,
+		Watchdog& watchdog)
+{
+	watchdog.setPasses(config.parameters.llvmPasses);
+	watchdog.setProgressCallback(waitBoxProgress);
+	config.parameters.llvmPasses = Watchdog::instrument(
+			config.parameters.llvmPasses
+	);
+
+	show_wait_box("Decompiling...");
+	bool failed = runDecompilation(config, output);
+	hide_wait_box();
+
+	if (watchdog.isUserCancelled())
+	{
+		INFO_MSG("Decompilation cancelled by the user.\n");
+		return true;
+	}
+	return failed && !watchdog.isCancelled();
+}
+
+/**
+ * Run the decompilation within the per-function budget (if any).
+ * If the budget is exceeded, \p cancelReason is set and the output is
+ * not valid.
+ * Returns \c true if something went wrong.
+ */
+bool runBudgetedDecompilation(
+		retdec::config::Config& config,
+		std::string* output,
+		std::string& cancelReason)
+{
+	Watchdog watchdog(
+			RetDec::options.functionTimeout,
+			RetDec::options.functionMemoryLimit
+	);
+	if (runWatchedDecompilation(config, output, watchdog))
+	{
+		return true;
+	}
+
+	if (watchdog.isCancelled())
+	{
+		cancelReason = watchdog.getReason();
+	}
+	return false;
+}
+
 Function* RetDec::selectiveDecompilation(
 		ea_t ea,
 		bool redecompile,
-		bool regressionTests)
+		bool regressionTests,
+		const std::string* profile)
 {
 	if (isRelocatable() && inf_get_min_ea() != 0)
 	{
@@ -118,6 +355,8 @@ Function* RetDec::selectiveDecompilation(
 		return nullptr;
 	}
 
+	Profiler profiler("selective", f->start_ea);
+
 	if (!redecompile)
 	{
 		auto it = fnc2fnc.find(f);
@@ -125,62 +364,259 @@ Function* RetDec::selectiveDecompilation(
 		{
 			return &it->second;
 		}
+
+		if (profile == nullptr && !regressionTests)
+		{
+			if (auto* fnc = readDecompiledOutput(f))
+			{
+				return fnc;
+			}
+		}
 	}
 
-	if (fillConfig(config))
+	// Result of any running refinement is outdated now.
+	refinements.erase(f->start_ea);
+	bool progressive = options.progressiveDecompilation && !regressionTests;
+
+	if (fillConfig(config, "", profile ? *profile : options.selectiveProfile))
 	{
 		return nullptr;
 	}
+	// Snapshot of the config owned by this decompilation.
+	retdec::config::Config request = config;
+
+	// The preview gets its own parameters, the full decompilation
+	// (in the background) gets the selected profile.
+	retdec::config::Config refinementConfig;
+	if (progressive)
+	{
+		refinementConfig = request;
+		if (reconfigure(request, options.previewProfile))
+		{
+			request = refinementConfig;
+			progressive = false;
+		}
+	}
 
-	std::set<ea_t> selectedFncs;
 	std::string output;
 	std::string* out = &output;
 
-	config.parameters.setOutputFormat("json");
-	retdec::common::AddressRange r(f->start_ea, f->end_ea);
-	config.parameters.selectedRanges.insert(r);
-	selectedFncs.insert(f->start_ea);
-	config.parameters.setIsSelectedDecodeOnly(true);
+	selectFunction(request, f);
+	if (progressive)
+	{
+		selectFunction(refinementConfig, f);
+	}
 
 	if (regressionTests)
 	{
-		config.parameters.setIsVerboseOutput(true);
-		config.parameters.setOutputFormat("plain");
-		config.parameters.setOutputFile(config.parameters.getInputFile() + ".c");
+		request.parameters.setIsVerboseOutput(true);
+		request.parameters.setOutputFormat("plain");
+		request.parameters.setOutputFile(request.parameters.getInputFile() + ".c");
 		out = nullptr;
 	}
 
-	show_wait_box("Decompiling...");
-	if (runDecompilation(config, out))
+	if (options.replayBundles)
+	{
+		std::stringstream name;
+		name << std::hex << f->start_ea;
+		writeReplayBundle(request, name.str(), f);
+	}
+
+	// Regression tests must be deterministic -> no budget.
+	if (regressionTests)
 	{
+		show_wait_box("Decompiling...");
+		runDecompilation(request, out);
 		hide_wait_box();
 		return nullptr;
 	}
-	hide_wait_box();
 
-	if (out == nullptr)
+	std::string cancelReason;
+	if (runBudgetedDecompilation(request, out, cancelReason))
+	{
+		return nullptr;
+	}
+	if (!cancelReason.empty())
+	{
+		qstring fncName;
+		get_func_name(&fncName, f->start_ea);
+		INFO_MSG("Decompilation of " << fncName.c_str() << " cancelled ("
+				<< cancelReason << "), decompiling it with the \""
+				<< options.fallbackProfile << "\" profile.\n"
+		);
+		if (reconfigure(request, options.fallbackProfile))
+		{
+			return nullptr;
+		}
+		selectFunction(request, f);
+
+		std::string fallbackReason;
+		output.clear();
+		if (runBudgetedDecompilation(request, out, fallbackReason))
+		{
+			return nullptr;
+		}
+		if (!fallbackReason.empty())
+		{
+			WARNING_GUI("Decompilation of " << fncName.c_str()
+					<< " was cancelled (" << fallbackReason << ") even with "
+					<< "the \"" << options.fallbackProfile << "\" profile.\n"
+			);
+			return nullptr;
+		}
+	}
+
+	FunctionBuilder builder(f);
+
+	bool degraded = !cancelReason.empty();
+	if (degraded)
+	{
+		builder.token(Token::Kind::COMMENT, f->start_ea,
+				"// Degraded decompilation - " + cancelReason
+				+ ", the \"" + options.fallbackProfile
+				+ "\" profile was used."
+		);
+		builder.token(Token::Kind::NEW_LINE, f->start_ea, "\n");
+		builder.token(Token::Kind::NEW_LINE, f->start_ea, "\n");
+	}
+
+	// Tokens go right into the function, without a vector of them.
+	{
+		ProfilerPhase phase("parseTokens");
+		auto banner = builder.size();
+		if (parseTokens(output, f->start_ea, builder)
+				|| builder.size() == banner)
+		{
+			return nullptr;
+		}
+	}
+
+	auto* fnc = &(fnc2fnc[f] = builder.take());
+	indexFunction(f->start_ea);
+
+	// Refinement of a degraded decompilation would hog the decompiler.
+	if (progressive && !degraded)
+	{
+		refinements[f->start_ea].id = background.submit(
+				f->start_ea,
+				refinementConfig
+		);
+		INFO_MSG("Showing preview of " << fnc->getName()
+				<< ", the full decompilation runs in the background.\n"
+		);
+	}
+
+	return fnc;
+}
+
+Function* RetDec::readDecompiledOutput(func_t* f)
+{
+	if (!decompiledOutput.contains(f->start_ea))
+	{
+		return nullptr;
+	}
+
+	ProfilerPhase phase("readOutput");
+	FunctionBuilder builder(f);
+	if (decompiledOutput.read(f->start_ea, builder) || builder.size() == 0)
 	{
+		qstring fncName;
+		get_func_name(&fncName, f->start_ea);
+		WARNING_MSG("Unable to read " << fncName.c_str() << " from "
+				<< decompiledOutput.getPath() << "\n"
+		);
 		return nullptr;
 	}
 
-	auto ts = parseTokens(output, f->start_ea);
-	if (ts.empty())
+	auto* fnc = &(fnc2fnc[f] = builder.take());
+	indexFunction(f->start_ea);
+	return fnc;
+}
+
+Function* RetDec::findFunction(ea_t start)
+{
+	func_t* f = get_func(start);
+	if (f == nullptr || f->start_ea != start)
 	{
 		return nullptr;
 	}
-	return &(fnc2fnc[f] = Function(f, ts));
+
+	auto it = fnc2fnc.find(f);
+	return it != fnc2fnc.end() ? &it->second : readDecompiledOutput(f);
 }
 
-Function* RetDec::selectiveDecompilationAndDisplay(ea_t ea, bool redecompile)
+Function* RetDec::selectiveDecompilationAndDisplay(
+		ea_t ea,
+		bool redecompile,
+		const std::string* profile)
 {
-	auto* f = selectiveDecompilation(ea, redecompile);
+	func_t* fnc = get_func(ea);
+	Profiler profiler("selective", fnc ? fnc->start_ea : ea);
+
+	// Re-decompilation of the displayed function keeps the cursor on its
+	// line (see redisplayFunction()).
+	std::vector<uint64_t> oldLines;
+	lochist_entry_t loc;
+	if (redecompile && fnc && this->fnc && this->fnc->fnc() == fnc
+			&& find_widget(RetDec::pluginName.c_str()) != nullptr
+			&& get_custom_viewer_location(&loc, custViewer))
+	{
+		oldLines = hashLines(*this->fnc);
+	}
+
+	auto* f = selectiveDecompilation(ea, redecompile, false, profile);
 	if (f)
 	{
-		displayFunction(f, ea);
+		ProfilerPhase phase("display");
+		if (f == this->fnc && !oldLines.empty())
+		{
+			redisplayFunction(oldLines, loc);
+		}
+		else
+		{
+			displayFunction(f, ea);
+		}
 	}
 	return f;
 }
 
+void RetDec::redisplayFunction(
+		const std::vector<uint64_t>& oldLines,
+		const lochist_entry_t& loc)
+{
+	auto* old = dynamic_cast<const retdec_place_t*>(loc.place());
+	if (old == nullptr || old->fnc() != fnc)
+	{
+		displayFunction(fnc, fnc->getStart());
+		return;
+	}
+
+	LineDiff diff(oldLines, hashLines(*fnc));
+	if (diff.identical())
+	{
+		refresh_custom_viewer(custViewer);
+		return;
+	}
+
+	// Kept lines are the same -> so is the column.
+	YX yx = old->yx();
+	yx = diff.isKept(yx.y)
+			? YX(diff.map(yx.y), yx.x)
+			: YX(diff.map(yx.y), YX::starting_x);
+
+	retdec_place_t min(fnc, fnc->min_yx());
+	retdec_place_t max(fnc, fnc->max_yx());
+	retdec_place_t cur(fnc, fnc->adjust_yx(yx));
+	set_custom_viewer_range(custViewer, &min, &max);
+
+	// The same row of the window as before.
+	lochist_entry_t now(loc);
+	now.set_place(cur);
+	now.renderer_info().pos.cx = cur.x();
+	custom_viewer_jump(custViewer, now);
+	refresh_custom_viewer(custViewer);
+}
+
 void RetDec::displayFunction(Function* f, ea_t ea)
 {
 	fnc = f;
@@ -228,6 +664,403 @@ void RetDec::displayFunction(Function* f, ea_t ea)
 	return;
 }
 
+void RetDec::backgroundDecompilation(const std::vector<func_t*>& fncs)
+{
+	if (fncs.empty())
+	{
+		return;
+	}
+	if (isRelocatable() && inf_get_min_ea() != 0)
+	{
+		WARNING_GUI("RetDec plugin can selectively decompile only "
+				"relocatable objects loaded at 0x0.\n"
+				"Rebase the program to 0x0 or use full decompilation."
+		);
+		return;
+	}
+
+	auto* bc = getBackgroundConfig();
+	if (bc == nullptr)
+	{
+		return;
+	}
+
+	if (refinementTimer == nullptr)
+	{
+		refinementTimer = register_timer(
+				refinementTimerPeriod,
+				refinementTimerCallback,
+				this
+		);
+	}
+
+	for (auto* f : fncs)
+	{
+		retdec::config::Config request = *bc;
+		selectFunction(request, f);
+		refinements[f->start_ea] = Refinement();
+		refinements[f->start_ea].id = background.submit(f->start_ea, request);
+	}
+
+	INFO_MSG("Decompiling " << fncs.size() << " function(s) in the background"
+			<< " (" << std::max(decompilerWorker().getWorkers(), 1u)
+			<< " at once).\n"
+	);
+}
+
+const retdec::config::Config* RetDec::getBackgroundConfig()
+{
+	if (!backgroundConfigValid)
+	{
+		if (fillConfig(backgroundConfig, "", options.selectiveProfile))
+		{
+			return nullptr;
+		}
+		backgroundConfigValid = true;
+	}
+	return &backgroundConfig;
+}
+
+ssize_t idaapi IdbListener::on_event(ssize_t code, va_list)
+{
+	switch (code)
+	{
+		// Names.
+		case idb_event::renamed:
+		// Functions.
+		case idb_event::func_added:
+		case idb_event::func_updated:
+		case idb_event::deleting_func:
+		case idb_event::set_func_start:
+		case idb_event::set_func_end:
+		case idb_event::func_tail_appended:
+		case idb_event::func_tail_deleted:
+		case idb_event::tail_owner_changed:
+		case idb_event::func_noret_changed:
+		// Types.
+		case idb_event::ti_changed:
+		case idb_event::local_types_changed:
+		case idb_event::op_type_changed:
+		// Code and data.
+		case idb_event::make_code:
+		case idb_event::make_data:
+		case idb_event::destroyed_items:
+		case idb_event::byte_patched:
+		// Segments.
+		case idb_event::segm_added:
+		case idb_event::segm_deleted:
+		case idb_event::segm_start_changed:
+		case idb_event::segm_end_changed:
+		case idb_event::segm_moved:
+		// Structures.
+		case idb_event::struc_created:
+		case idb_event::deleting_struc:
+		case idb_event::struc_renamed:
+		case idb_event::struc_expanded:
+		case idb_event::struc_member_created:
+		case idb_event::struc_member_deleted:
+		case idb_event::struc_member_renamed:
+		case idb_event::struc_member_changed:
+		// Function comments.
+		case idb_event::range_cmt_changed:
+		{
+			RetDec::backgroundConfigValid = false;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+void RetDec::refineFunctions()
+{
+	// Zygotes died while serving background decompilations.
+	decompilerWorker().respawn();
+
+	for (auto& job : background.takeFinished())
+	{
+		auto rIt = refinements.find(job.ea);
+		if (rIt == refinements.end() || rIt->second.id != job.id)
+		{
+			continue; // superseded
+		}
+		auto edits = std::move(rIt->second.edits);
+		bool warmup = rIt->second.warmup;
+		refinements.erase(rIt);
+
+		if (!job.error.empty())
+		{
+			WARNING_MSG("Background decompilation exception: "
+					<< job.error << "\n"
+			);
+			continue;
+		}
+
+		func_t* f = get_func(job.ea);
+		if (f == nullptr || f->start_ea != job.ea)
+		{
+			continue;
+		}
+
+		auto ts = parseTokens(job.output, f->start_ea);
+		if (ts.empty())
+		{
+			continue;
+		}
+		for (auto& t : ts)
+		{
+			for (auto& e : edits)
+			{
+				if (t.kind == std::get<0>(e) && t.value == std::get<1>(e))
+				{
+					t.value = std::get<2>(e);
+				}
+			}
+		}
+
+		refineFunction(f, ts, warmup);
+	}
+}
+
+void RetDec::refineFunction(
+		func_t* f,
+		const std::vector<Token>& tokens,
+		bool quiet)
+{
+	auto fIt = fnc2fnc.find(f);
+	if (fIt == fnc2fnc.end())
+	{
+		auto& F = fnc2fnc[f] = Function(f, tokens);
+		indexFunction(f->start_ea);
+		if (!quiet)
+		{
+			INFO_MSG("Decompilation of " << F.getName() << " done.\n");
+		}
+
+		// The viewer may be waiting for it at a place restored from the IDB.
+		if (fnc && retdec_place_t::isPlaceholder(fnc)
+				&& fnc->getStart() == f->start_ea
+				&& find_widget(RetDec::pluginName.c_str()) != nullptr)
+		{
+			auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+					custViewer,
+					false, // mouse
+					nullptr, // x
+					nullptr // y
+			));
+			// Synchronized disassembly's address, if it is in the function.
+			ea_t ea = get_screen_ea();
+			YX yx = F.ea_inside(ea) ? F.ea_2_yx(ea)
+					: place ? F.adjust_yx(place->yx())
+					: F.min_yx();
+
+			fnc = &F;
+			retdec_place_t min(&F, F.min_yx());
+			retdec_place_t max(&F, F.max_yx());
+			retdec_place_t cur(&F, yx);
+			set_custom_viewer_range(custViewer, &min, &max);
+			jumpto(custViewer, &cur, cur.x(), cur.y());
+			refresh_custom_viewer(custViewer);
+		}
+		return;
+	}
+	Function& F = fIt->second;
+
+	// Keep the cursor on the same address.
+	bool displayed = fnc == &F
+			&& find_widget(RetDec::pluginName.c_str()) != nullptr;
+	ea_t ea = BADADDR;
+	if (displayed)
+	{
+		auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+				custViewer,
+				false, // mouse
+				nullptr, // x
+				nullptr // y
+		));
+		if (place && place->fnc() == &F)
+		{
+			ea = F.yx_2_ea(place->yx());
+		}
+	}
+
+	// Places keep pointers to the Function -> replace it in place.
+	F = Function(f, tokens);
+	indexFunction(f->start_ea);
+	INFO_MSG("Full decompilation of " << F.getName() << " done.\n");
+
+	if (displayed)
+	{
+		retdec_place_t min(&F, F.min_yx());
+		retdec_place_t max(&F, F.max_yx());
+		retdec_place_t cur(&F, ea != BADADDR ? F.ea_2_yx(ea) : F.min_yx());
+		set_custom_viewer_range(custViewer, &min, &max);
+		jumpto(custViewer, &cur, cur.x(), cur.y());
+		refresh_custom_viewer(custViewer);
+	}
+}
+
+/**
+ * Stream RetDec's JSON output \p jsonPath into the C source \p cPath and
+ * the tokens \p tokensPath (see output.h), and remove it. The output is
+ * never in memory as a whole, and every function is on the disk as soon
+ * as it is parsed.
+ * Returns \c true if something went wrong.
+ */
+bool writeOutput(
+		const std::string& jsonPath,
+		const std::string& cPath,
+		const std::string& tokensPath)
+{
+	ProfilerPhase phase("writeOutput");
+	OutputWriter writer;
+	bool failed = writer.open(cPath, tokensPath)
+			|| parseTokensFile(jsonPath, BADADDR, writer);
+	failed |= writer.close();
+
+	std::error_code ec;
+	fs::remove(jsonPath, ec);
+	if (failed)
+	{
+		WARNING_GUI("Unable to write the decompiled output into "
+				<< cPath << " and " << tokensPath << "\n"
+		);
+	}
+	return failed;
+}
+
+/**
+ * Write \p old with the parts of the functions in \p fresh replaced by
+ * their new parts. The biggest part (i.e. the definition) replaces
+ * the biggest one, the others (e.g. declarations) are replaced in order.
+ * Returns \c true if something went wrong.
+ */
+bool stitchOutput(
+		const DecompiledOutput& old,
+		const DecompiledOutput& fresh,
+		const std::string& cPath,
+		const std::string& tokensPath)
+{
+	ProfilerPhase phase("stitchOutput");
+
+	// Function -> its other than biggest parts.
+	std::map<ea_t, std::vector<std::size_t>> freshParts;
+	for (std::size_t i = 0; i < fresh.parts(); ++i)
+	{
+		ea_t f = fresh.getPartFunction(i);
+		if (f != BADADDR && fresh.getFunctionPart(f) != i)
+		{
+			freshParts[f].push_back(i);
+		}
+	}
+	std::map<ea_t, std::size_t> lastParts;
+	for (std::size_t i = 0; i < old.parts(); ++i)
+	{
+		lastParts[old.getPartFunction(i)] = i;
+	}
+
+	OutputWriter writer;
+	if (writer.open(cPath, tokensPath))
+	{
+		return true;
+	}
+	bool failed = false;
+	std::map<ea_t, std::size_t> used;
+	for (std::size_t i = 0; i < old.parts(); ++i)
+	{
+		ea_t f = old.getPartFunction(i);
+		if (f == BADADDR || !fresh.contains(f))
+		{
+			failed |= old.readPart(i, writer);
+			continue;
+		}
+
+		auto& parts = freshParts[f];
+		auto& k = used[f];
+		if (old.getFunctionPart(f) == i)
+		{
+			failed |= fresh.readPart(fresh.getFunctionPart(f), writer);
+		}
+		else if (k < parts.size())
+		{
+			failed |= fresh.readPart(parts[k++], writer);
+		}
+		else
+		{
+			// Better an outdated declaration than none.
+			failed |= old.readPart(i, writer);
+		}
+		while (lastParts[f] == i && k < parts.size())
+		{
+			failed |= fresh.readPart(parts[k++], writer);
+		}
+	}
+
+	return writer.close() || failed;
+}
+
+/**
+ * Re-decompile only the \p changed functions of the full decompilation
+ * configured by RetDec::config, and stitch them with the rest of its
+ * previous output \p old.
+ * Returns \c true if something went wrong.
+ */
+bool updateFullDecompilation(
+		DecompiledOutput& old,
+		const std::vector<ea_t>& changed,
+		const std::string& out,
+		const std::string& tokensPath)
+{
+	std::string partialJson = out + ".partial.json";
+	std::string partialC = out + ".partial";
+	std::string partialTokens = tokensPath + ".partial";
+	std::string stitchedTokens = tokensPath + ".new";
+
+	std::error_code ec;
+	DecompiledOutput fresh;
+	if (!changed.empty())
+	{
+		retdec::config::Config request = RetDec::config;
+		for (auto ea : changed)
+		{
+			if (func_t* f = get_func(ea))
+			{
+				selectFunction(request, f);
+			}
+		}
+		request.parameters.setOutputFile(partialJson);
+
+		Watchdog watchdog(0, 0);
+		if (runWatchedDecompilation(request, nullptr, watchdog)
+				|| watchdog.isCancelled()
+				|| writeOutput(partialJson, partialC, partialTokens)
+				|| fresh.open(partialTokens))
+		{
+			fs::remove(partialJson, ec);
+			fs::remove(partialC, ec);
+			fs::remove(partialTokens, ec);
+			return true;
+		}
+	}
+
+	bool failed = stitchOutput(old, fresh, out, stitchedTokens);
+	old.close();
+	fresh.close();
+
+	fs::remove(partialC, ec);
+	fs::remove(partialTokens, ec);
+	if (failed)
+	{
+		WARNING_GUI("Unable to write the decompiled output into "
+				<< out << " and " << tokensPath << "\n"
+		);
+		fs::remove(stitchedTokens, ec);
+		return true;
+	}
+	fs::rename(stitchedTokens, tokensPath, ec);
+	return bool(ec);
+}
+
 bool RetDec::fullDecompilation()
 {
 	std::string defaultOut = getInputPath() + ".c";
@@ -246,17 +1079,375 @@ bool RetDec::fullDecompilation()
 
 	INFO_MSG("Selected file: " << out << "\n");
 
-	if (fillConfig(config, out))
+	Profiler profiler("full");
+	if (fillConfig(config, out, options.fullProfile))
 	{
 		return false;
 	}
-	config.parameters.setOutputFormat("c");
+	// Incremental decompilation reuses the tokens of the previous one.
+	bool incremental = options.incrementalFullDecompilation;
+	// Browsable output is written from the tokens, see below.
+	bool browsable = options.browsableFullDecompilation || incremental;
+	config.parameters.setOutputFormat(browsable ? "json" : "c");
+	std::string jsonPath = out + ".json";
 
-	show_wait_box("Decompiling...");
-	runDecompilation(config);
+	std::string tokensPath = fs::path(out).replace_extension(".rdtk").string();
+	std::string manifestPath = fs::path(out)
+			.replace_extension(".manifest.json").string();
+	if (browsable && decompiledOutput.getPath() == tokensPath)
+	{
+		decompiledOutput.close(); // About to be overwritten.
+	}
+
+	Manifest manifest;
+	if (incremental)
+	{
+		{
+			ProfilerPhase phase("manifest");
+			manifest = computeManifest(config);
+		}
+
+		// The manifest must not outlive the output it describes.
+		Manifest old;
+		bool updatable = !loadManifest(manifestPath, old);
+		std::error_code ec;
+		fs::remove(manifestPath, ec);
+
+		std::vector<ea_t> changed;
+		DecompiledOutput oldOutput;
+		// Changing over a half of the functions is faster all at once.
+		if (updatable
+				&& !getChangedFunctions(old, manifest, changed)
+				&& changed.size() <= manifest.functions.size() / 2
+				&& !oldOutput.open(tokensPath))
+		{
+			INFO_MSG("Re-decompiling " << changed.size() << " changed of "
+					<< manifest.functions.size() << " function(s).\n"
+			);
+			if (updateFullDecompilation(oldOutput, changed, out, tokensPath))
+			{
+				return false;
+			}
+			saveManifest(manifestPath, manifest);
+			return !openDecompiledOutput(tokensPath);
+		}
+		INFO_MSG("The previous output cannot be reused, "
+				"decompiling all the functions.\n"
+		);
+	}
+
+	// RetDec writes the JSON output into a file, not into memory.
+	retdec::config::Config request = config;
+	if (browsable)
+	{
+		request.parameters.setOutputFile(jsonPath);
+	}
+
+	// The request as run - replays write the same output.
+	if (options.replayBundles)
+	{
+		writeReplayBundle(request, "full");
+	}
+
+	// No budget, only progress and cancellation.
+	Watchdog watchdog(0, 0);
+	if (runWatchedDecompilation(request, nullptr, watchdog))
+	{
+		// Do not leave a half-baked output behind.
+		std::error_code ec;
+		if (watchdog.isUserCancelled())
+		{
+			fs::remove(request.parameters.getOutputFile(), ec);
+		}
+		return false;
+	}
+	if (!browsable)
+	{
+		return true;
+	}
+
+	if (writeOutput(jsonPath, out, tokensPath))
+	{
+		return false;
+	}
+
+	if (incremental)
+	{
+		saveManifest(manifestPath, manifest);
+	}
+	return !openDecompiledOutput(tokensPath);
+}
+
+bool RetDec::openDecompiledOutput(const std::string& path)
+{
+	if (decompiledOutput.open(path))
+	{
+		WARNING_GUI("Unable to open the decompiled output " << path << "\n");
+		return true;
+	}
+	searchIndex.removeOutput();
+	xrefGraph.removeOutput();
+	outputIndexed = false;
+	// Its functions can be found now.
+	retdec_place_t::functionsChanged();
+	INFO_MSG("Browsing " << decompiledOutput.size()
+			<< " decompiled function(s) from " << path << "\n"
+	);
+
+	// The function under the cursor, or the first one in the output.
+	ea_t ea = get_screen_ea();
+	func_t* f = get_func(ea);
+	if (f == nullptr || !decompiledOutput.contains(f->start_ea))
+	{
+		ea = BADADDR;
+		for (std::size_t i = 0; i < decompiledOutput.size(); ++i)
+		{
+			if (get_func(decompiledOutput.getStart(i)))
+			{
+				ea = decompiledOutput.getStart(i);
+				break;
+			}
+		}
+	}
+	if (ea == BADADDR)
+	{
+		WARNING_GUI("No function of " << path << " is in the database.\n");
+		return true;
+	}
+
+	return selectiveDecompilationAndDisplay(ea, false) == nullptr;
+}
+
+bool RetDec::readFunctionTokens(ea_t start, TokenSink& sink)
+{
+	func_t* f = get_func(start);
+	auto it = f && f->start_ea == start ? fnc2fnc.find(f) : fnc2fnc.end();
+	if (it == fnc2fnc.end())
+	{
+		return decompiledOutput.read(start, sink);
+	}
+
+	for (auto& t : it->second.getTokens())
+	{
+		sink.token(t.second.kind, t.second.ea, t.second.value);
+	}
+	return false;
+}
+
+void RetDec::indexFunction(ea_t start, bool fromOutput)
+{
+	retdec_place_t::functionsChanged();
+	searchIndex.add(start, readFunctionTokens, fromOutput);
+	xrefGraph.add(start, readFunctionTokens, fromOutput);
+}
+
+bool RetDec::indexDecompiledOutput()
+{
+	if (outputIndexed || !decompiledOutput.isOpen())
+	{
+		return false;
+	}
+
+	ProfilerPhase phase("indexOutput");
+	show_wait_box("Indexing the decompiled output...");
+	for (std::size_t i = 0; i < decompiledOutput.size(); ++i)
+	{
+		if (user_cancelled())
+		{
+			hide_wait_box();
+			return true;
+		}
+
+		// Cached functions are already indexed, maybe edited.
+		ea_t start = decompiledOutput.getStart(i);
+		if (!searchIndex.contains(start))
+		{
+			indexFunction(start, true);
+		}
+	}
 	hide_wait_box();
+	outputIndexed = true;
+	return false;
+}
 
-	return true;
+bool RetDec::searchDecompiledCode(
+		SearchIndex::Query query,
+		const std::string& text,
+		std::vector<SearchIndex::Result>& results)
+{
+	if (indexDecompiledOutput())
+	{
+		return true;
+	}
+
+	std::string error;
+	if (searchIndex.search(query, text, readFunctionTokens, 10000, results, error))
+	{
+		WARNING_GUI("Invalid search query " << text << ": " << error << "\n");
+		return true;
+	}
+	return false;
+}
+
+bool RetDec::findPseudocodeXrefs(
+		Token::Kind kind,
+		const std::string& name,
+		std::vector<XrefGraph::Xref>& xrefs)
+{
+	if (indexDecompiledOutput())
+	{
+		return true;
+	}
+
+	xrefs = xrefGraph.find(kind, name);
+	return false;
+}
+
+namespace {
+
+/**
+ * Starts of the functions in the order of the warmup, reversed (the first
+ * one is at the back) - entry points and exports, then the other functions
+ * by the number of references to them. Library functions are skipped.
+ */
+std::vector<ea_t> warmupOrder()
+{
+	std::vector<ea_t> order;
+	std::set<ea_t> entries;
+	for (size_t i = 0; i < get_entry_qty(); ++i)
+	{
+		func_t* f = get_func(get_entry(get_entry_ordinal(i)));
+		if (f && entries.insert(f->start_ea).second)
+		{
+			order.push_back(f->start_ea);
+		}
+	}
+
+	std::vector<std::pair<unsigned, ea_t>> rest;
+	for (size_t i = 0; i < get_func_qty(); ++i)
+	{
+		func_t* f = getn_func(i);
+		if (f == nullptr
+				|| (f->flags & FUNC_LIB)
+				|| entries.count(f->start_ea))
+		{
+			continue;
+		}
+
+		unsigned refs = 0;
+		xrefblk_t xb;
+		for (bool ok = xb.first_to(f->start_ea, XREF_FAR); ok; ok = xb.next_to())
+		{
+			++refs;
+		}
+		rest.emplace_back(refs, f->start_ea);
+	}
+	std::stable_sort(rest.begin(), rest.end(), [](auto& a, auto& b)
+	{
+		return a.first > b.first;
+	});
+	for (auto& r : rest)
+	{
+		order.push_back(r.second);
+	}
+
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+} // anonymous namespace
+
+bool RetDec::warmup()
+{
+	if (!auto_is_ok())
+	{
+		return false;
+	}
+
+	// Pause while the user is moving around.
+	auto now = std::chrono::steady_clock::now();
+	ea_t ea = get_screen_ea();
+	TWidget* widget = get_current_widget();
+	if (ea != warmupLastEa || widget != warmupLastWidget)
+	{
+		warmupLastEa = ea;
+		warmupLastWidget = widget;
+		warmupLastMove = now;
+		return false;
+	}
+	if (now - warmupLastMove < warmupIdleDelay)
+	{
+		return false;
+	}
+
+	// One batch at a time - the user's own decompilations wait at most for
+	// the running one.
+	if (!background.idle() || !refinements.empty())
+	{
+		return false;
+	}
+
+	if (!warmupStarted)
+	{
+		warmupStarted = true;
+		if (isRelocatable() && inf_get_min_ea() != 0)
+		{
+			INFO_MSG("Warmup is not possible, relocatable objects must be "
+					"loaded at 0x0.\n"
+			);
+			return true;
+		}
+		warmupQueue = warmupOrder();
+		INFO_MSG("Warmup: decompiling " << warmupQueue.size()
+				<< " function(s) in the background while IDA is idle.\n"
+		);
+	}
+
+	std::vector<func_t*> batch;
+	std::size_t batchSize = std::max(decompilerWorker().getWorkers(), 1u);
+	while (batch.size() < batchSize && !warmupQueue.empty())
+	{
+		ea_t start = warmupQueue.back();
+		warmupQueue.pop_back();
+		func_t* f = get_func(start);
+		if (f && f->start_ea == start
+				&& fnc2fnc.count(f) == 0
+				&& !decompiledOutput.contains(start))
+		{
+			batch.push_back(f);
+		}
+	}
+	if (batch.empty())
+	{
+		INFO_MSG("Warmup done, " << fnc2fnc.size()
+				<< " function(s) decompiled.\n"
+		);
+		return true;
+	}
+
+	// Generated once per warmup, unless the database changes.
+	auto* bc = getBackgroundConfig();
+	if (bc == nullptr)
+	{
+		return true;
+	}
+	if (refinementTimer == nullptr)
+	{
+		refinementTimer = register_timer(
+				refinementTimerPeriod,
+				refinementTimerCallback,
+				this
+		);
+	}
+	for (auto* f : batch)
+	{
+		retdec::config::Config request = *bc;
+		selectFunction(request, f);
+		auto& r = refinements[f->start_ea] = Refinement();
+		r.id = background.submit(f->start_ea, request);
+		r.warmup = true;
+	}
+	return false;
 }
 
 bool idaapi RetDec::run(size_t arg)
@@ -328,6 +1519,19 @@ bool idaapi RetDec::run(size_t arg)
 RetDec::~RetDec()
 {
 	unhook_event_listener(HT_UI, this);
+	unhook_event_listener(HT_IDB, &idbListener);
+	if (refinementTimer)
+	{
+		unregister_timer(refinementTimer);
+	}
+	if (warmupTimer)
+	{
+		unregister_timer(warmupTimer);
+	}
+	// Killed workers unblock the background threads waiting for them.
+	decompilerWorker().stop();
+	background.stop();
+	decompiledOutput.close();
 }
 
 void RetDec::modifyFunctions(
@@ -354,6 +1558,20 @@ void RetDec::modifyFunction(
 	}
 	Function& F = fIt->second;
 
+	// The refinement may refer to the renamed object even if the preview
+	// does not.
+	auto rIt = refinements.find(f->start_ea);
+	if (rIt != refinements.end())
+	{
+		rIt->second.edits.emplace_back(k, oldVal, newVal);
+	}
+
+	// Most of the functions do not refer to the renamed object at all.
+	if (F.getOccurrences(k, oldVal).empty())
+	{
+		return;
+	}
+
 	std::vector<Token> newTokens;
 
 	for (auto& t : F.getTokens())
@@ -369,6 +1587,7 @@ void RetDec::modifyFunction(
 	}
 
 	fIt->second = Function(f, newTokens);
+	indexFunction(f->start_ea);
 }
 
 ea_t RetDec::getFunctionEa(const std::string& name)
@@ -2,20 +2,55 @@
 #ifndef RETDEC_RETDEC_H
 #define RETDEC_RETDEC_H
 
+#include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <list>
 #include <map>
 #include <set>
 #include <sstream>
+#include <tuple>
 
 #include <retdec/config/config.h>
 #include <retdec/utils/filesystem.h>
 #include <retdec/utils/time.h>
 
+#include "background.h"
 #include "function.h"
+#include "options.h"
+#include "output.h"
+#include "profiles.h"
+#include "search.h"
 #include "ui.h"
 #include "utils.h"
+#include "xrefs.h"
+
+/**
+ * Pending background refinement of a preview decompilation, or a pending
+ * background decompilation.
+ */
+struct Refinement
+{
+	/// ID of the background job.
+	unsigned id = 0;
+	/// Modifications (renames) of the preview tokens to redo in
+	/// the refined tokens.
+	std::vector<std::tuple<Token::Kind, std::string, std::string>> edits;
+	/// Submitted by the warmup (see RetDec::warmup()).
+	bool warmup = false;
+};
+
+/**
+ * Watches the database - changes of what the config is filled from (names,
+ * functions, types, items, segments, structures, function comments)
+ * invalidate the cached config of the background decompilations (see
+ * RetDec::getBackgroundConfig()). Other changes (e.g. instruction comments)
+ * keep it.
+ */
+struct IdbListener : public event_listener_t
+{
+	virtual ssize_t idaapi on_event(ssize_t code, va_list va) override;
+};
 
 /**
  * Plugin's global data.
@@ -53,15 +88,66 @@ class RetDec : public plugmod_t, public event_listener_t
 	// Decompilation.
 	//
 	public:
-		static bool fullDecompilation();
+		bool fullDecompilation();
+		/// Open the tokens of a full decompilation (see output.h) - its
+		/// functions are then displayed without decompiling them.
+		/// Returns \c true if something went wrong.
+		bool openDecompiledOutput(const std::string& path);
+		/// \p profile overrides Options::selectiveProfile.
 		static Function* selectiveDecompilation(
 				ea_t ea,
 				bool redecompile,
-				bool regressionTests = false
+				bool regressionTests = false,
+				const std::string* profile = nullptr
 		);
 
-		Function* selectiveDecompilationAndDisplay(ea_t ea, bool redecompile);
+		/// Page \p f in from decompiledOutput into fnc2fnc.
+		/// Returns \c nullptr if it is not there.
+		static Function* readDecompiledOutput(func_t* f);
+		/// The function starting at \p start if it is decompiled - cached,
+		/// or in decompiledOutput. Never decompiles.
+		static Function* findFunction(ea_t start);
+
+		Function* selectiveDecompilationAndDisplay(
+				ea_t ea,
+				bool redecompile,
+				const std::string* profile = nullptr
+		);
 		void displayFunction(Function* f, ea_t ea);
+		/// Display the re-decompiled fnc - the cursor stays on its line, at
+		/// the same row of the window, if the line was not changed.
+		/// \p oldLines are hashLines() of the old version, \p loc its
+		/// location in the viewer.
+		void redisplayFunction(
+				const std::vector<uint64_t>& oldLines,
+				const lochist_entry_t& loc
+		);
+
+		/// Decompile \p fncs in the background, they are added to fnc2fnc
+		/// when finished.
+		void backgroundDecompilation(const std::vector<func_t*>& fncs);
+		/// Config of the background decompilations - generated by the first
+		/// one, and again only after the database changes. Generating it
+		/// costs all the functions and globals of the database.
+		/// Returns \c nullptr if something went wrong.
+		static const retdec::config::Config* getBackgroundConfig();
+
+		/// Replace previews by the finished background refinements, add
+		/// the finished background decompilations.
+		void refineFunctions();
+		/// \p quiet does not report new functions.
+		void refineFunction(
+				func_t* f,
+				const std::vector<Token>& tokens,
+				bool quiet = false
+		);
+
+		/// Decompile the next few functions in the background if IDA is
+		/// idle - the autoanalysis is finished, the user has not moved for
+		/// a while, and no other background decompilation is running
+		/// (see Options::warmupDecompilation). Called periodically.
+		/// Returns \c true when there is nothing more to decompile.
+		bool warmup();
 
 		void modifyFunctions(
 				Token::Kind k,
@@ -75,6 +161,33 @@ class RetDec : public plugmod_t, public event_listener_t
 				const std::string& newVal
 		);
 
+		/// Read the tokens of the function starting at \p start - the cached
+		/// ones if decompiled, or the ones from decompiledOutput.
+		/// Returns \c true if something went wrong.
+		static bool readFunctionTokens(ea_t start, TokenSink& sink);
+		/// (Re)index the function starting at \p start for the search and
+		/// the pseudocode xrefs. Called whenever a function in fnc2fnc
+		/// changes.
+		static void indexFunction(ea_t start, bool fromOutput = false);
+		/// Index the functions of decompiledOutput, if not yet indexed.
+		/// Returns \c true if cancelled by the user.
+		static bool indexDecompiledOutput();
+		/// Search all the decompiled functions (see SearchIndex).
+		/// Returns \c true if something went wrong.
+		bool searchDecompiledCode(
+				SearchIndex::Query query,
+				const std::string& text,
+				std::vector<SearchIndex::Result>& results
+		);
+		/// Places of the decompiled functions referring to the symbol
+		/// \p name of the kind \p kind (see XrefGraph).
+		/// Returns \c true if something went wrong.
+		bool findPseudocodeXrefs(
+				Token::Kind kind,
+				const std::string& name,
+				std::vector<XrefGraph::Xref>& xrefs
+		);
+
 		ea_t getFunctionEa(const std::string& name);
 		func_t* getIdaFunction(const std::string& name);
 		ea_t getGlobalVarEa(const std::string& name);
@@ -85,9 +198,42 @@ class RetDec : public plugmod_t, public event_listener_t
 		/// All the decompiled functions.
 		static std::map<func_t*, Function> fnc2fnc;
 
+		/// Opened output of a full decompilation.
+		static DecompiledOutput decompiledOutput;
+
+		/// Indices of the cached and the exported functions. The exported
+		/// ones are indexed by the first query after opening the output.
+		static SearchIndex searchIndex;
+		static XrefGraph xrefGraph;
+		static bool outputIndexed;
+
 		/// Decompilation config.
 		static retdec::config::Config config;
 
+		/// Plugin options.
+		static Options options;
+
+		/// Named decompilation profiles.
+		static Profiles profiles;
+
+		/// Background refinements of previews (progressive decompilation)
+		/// and background decompilations.
+		static BackgroundDecompiler background;
+		static std::map<ea_t, Refinement> refinements;
+		qtimer_t refinementTimer = nullptr;
+		static retdec::config::Config backgroundConfig;
+		static bool backgroundConfigValid;
+		IdbListener idbListener;
+
+		/// Warmup state - starts of the functions still to decompile, in
+		/// reverse order, and the user's last position and its time.
+		qtimer_t warmupTimer = nullptr;
+		bool warmupStarted = false;
+		std::vector<ea_t> warmupQueue;
+		ea_t warmupLastEa = BADADDR;
+		TWidget* warmupLastWidget = nullptr;
+		std::chrono::steady_clock::time_point warmupLastMove;
+
 	// UI.
 	//
 	public:
@@ -105,6 +251,28 @@ class RetDec : public plugmod_t, public event_listener_t
 				-1
 		);
 
+		openOutput_ah_t openOutput_ah = openOutput_ah_t(*this);
+		const action_desc_t openOutput_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				openOutput_ah_t::actionName,
+				openOutput_ah_t::actionLabel,
+				&openOutput_ah,
+				this,
+				openOutput_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
+		search_ah_t search_ah = search_ah_t(*this);
+		const action_desc_t search_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				search_ah_t::actionName,
+				search_ah_t::actionLabel,
+				&search_ah,
+				this,
+				search_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
 		jump2asm_ah_t jump2asm_ah = jump2asm_ah_t(*this);
 		const action_desc_t jump2asm_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
 				jump2asm_ah_t::actionName,
@@ -127,6 +295,39 @@ class RetDec : public plugmod_t, public event_listener_t
 				-1
 		);
 
+		copy2asmFunctions_ah_t copy2asmFunctions_ah = copy2asmFunctions_ah_t(*this);
+		const action_desc_t copy2asmFunctions_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				copy2asmFunctions_ah_t::actionName,
+				copy2asmFunctions_ah_t::actionLabel,
+				&copy2asmFunctions_ah,
+				this,
+				copy2asmFunctions_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
+		nextOccurrence_ah_t nextOccurrence_ah = nextOccurrence_ah_t(*this);
+		const action_desc_t nextOccurrence_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				nextOccurrence_ah_t::actionName,
+				nextOccurrence_ah_t::actionLabel,
+				&nextOccurrence_ah,
+				this,
+				nextOccurrence_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
+		prevOccurrence_ah_t prevOccurrence_ah = prevOccurrence_ah_t(*this);
+		const action_desc_t prevOccurrence_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				prevOccurrence_ah_t::actionName,
+				prevOccurrence_ah_t::actionLabel,
+				&prevOccurrence_ah,
+				this,
+				prevOccurrence_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
 		funcComment_ah_t funcComment_ah = funcComment_ah_t(*this);
 		const action_desc_t funcComment_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
 				funcComment_ah_t::actionName,
@@ -149,6 +350,17 @@ class RetDec : public plugmod_t, public event_listener_t
 				-1
 		);
 
+		renameLocal_ah_t renameLocal_ah = renameLocal_ah_t(*this);
+		const action_desc_t renameLocal_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				renameLocal_ah_t::actionName,
+				renameLocal_ah_t::actionLabel,
+				&renameLocal_ah,
+				this,
+				renameLocal_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
 		openXrefs_ah_t openXrefs_ah = openXrefs_ah_t(*this);
 		const action_desc_t openXrefs_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
 				openXrefs_ah_t::actionName,
@@ -160,6 +372,17 @@ class RetDec : public plugmod_t, public event_listener_t
 				-1
 		);
 
+		pseudocodeXrefs_ah_t pseudocodeXrefs_ah = pseudocodeXrefs_ah_t(*this);
+		const action_desc_t pseudocodeXrefs_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				pseudocodeXrefs_ah_t::actionName,
+				pseudocodeXrefs_ah_t::actionLabel,
+				&pseudocodeXrefs_ah,
+				this,
+				pseudocodeXrefs_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
 		openCalls_ah_t openCalls_ah = openCalls_ah_t(*this);
 		const action_desc_t openCalls_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
 				openCalls_ah_t::actionName,
@@ -171,6 +394,28 @@ class RetDec : public plugmod_t, public event_listener_t
 				-1
 		);
 
+		profileDecompilation_ah_t profileDecompilation_ah = profileDecompilation_ah_t(*this);
+		const action_desc_t profileDecompilation_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				profileDecompilation_ah_t::actionName,
+				profileDecompilation_ah_t::actionLabel,
+				&profileDecompilation_ah,
+				this,
+				profileDecompilation_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
+		backgroundDecompilation_ah_t backgroundDecompilation_ah = backgroundDecompilation_ah_t(*this);
+		const action_desc_t backgroundDecompilation_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
+				backgroundDecompilation_ah_t::actionName,
+				backgroundDecompilation_ah_t::actionLabel,
+				&backgroundDecompilation_ah,
+				this,
+				backgroundDecompilation_ah_t::actionHotkey,
+				nullptr,
+				-1
+		);
+
 		changeFuncType_ah_t changeFuncType_ah = changeFuncType_ah_t(*this);
 		const action_desc_t changeFuncType_ah_desc = ACTION_DESC_LITERAL_PLUGMOD(
 				changeFuncType_ah_t::actionName,
@@ -0,0 +1,313 @@
+
+#include <algorithm>
+#include <regex>
+#include <string_view>
+#include <unordered_set>
+
+#include "search.h"
+
+namespace {
+
+uint32_t kindBit(Token::Kind kind)
+{
+	return 1u << unsigned(kind);
+}
+
+const uint32_t identifierKinds =
+		kindBit(Token::Kind::ID_GVAR)
+		| kindBit(Token::Kind::ID_LVAR)
+		| kindBit(Token::Kind::ID_MEM)
+		| kindBit(Token::Kind::ID_LAB)
+		| kindBit(Token::Kind::ID_FNC)
+		| kindBit(Token::Kind::ID_ARG);
+
+const uint32_t literalKinds =
+		kindBit(Token::Kind::LITERAL_BOOL)
+		| kindBit(Token::Kind::LITERAL_INT)
+		| kindBit(Token::Kind::LITERAL_FP)
+		| kindBit(Token::Kind::LITERAL_STR)
+		| kindBit(Token::Kind::LITERAL_SYM)
+		| kindBit(Token::Kind::LITERAL_PTR);
+
+/// Punctuation, operators, keywords, ... are not worth indexing.
+const uint32_t indexedKinds =
+		identifierKinds
+		| literalKinds
+		| kindBit(Token::Kind::TYPE)
+		| kindBit(Token::Kind::COMMENT);
+
+uint32_t queryKinds(SearchIndex::Query query)
+{
+	switch (query)
+	{
+		case SearchIndex::Query::IDENTIFIER: return identifierKinds;
+		case SearchIndex::Query::LITERAL: return literalKinds;
+		default: return indexedKinds;
+	}
+}
+
+/**
+ * Collects the distinct indexed values of a function.
+ */
+class Indexer : public TokenSink
+{
+	public:
+		virtual void token(
+				Token::Kind kind,
+				ea_t,
+				const std::string& value) override
+		{
+			if ((indexedKinds & kindBit(kind)) && !value.empty())
+			{
+				terms[value] |= kindBit(kind);
+			}
+		}
+
+	public:
+		std::unordered_map<std::string, uint32_t> terms;
+};
+
+/**
+ * Finds the matching tokens of a function. Tracks YX the same way as
+ * Function does when the tokens are appended to it.
+ */
+class Scanner : public TokenSink
+{
+	public:
+		Scanner(
+				ea_t fnc,
+				uint32_t kinds,
+				const std::unordered_set<std::string_view>& values,
+				std::vector<SearchIndex::Result>& results)
+				: _fnc(fnc)
+				, _kinds(kinds)
+				, _values(values)
+				, _results(results)
+		{
+
+		}
+
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value) override
+		{
+			if ((_kinds & kindBit(kind)) && _values.count(value))
+			{
+				SearchIndex::Result r;
+				r.fnc = _fnc;
+				r.yx = _yx;
+				r.ea = ea;
+				r.kind = kind;
+				r.value = value;
+				_results.push_back(std::move(r));
+			}
+
+			if (kind == Token::Kind::NEW_LINE)
+			{
+				_yx.y += 1;
+				_yx.x = YX::starting_x;
+			}
+			else
+			{
+				_yx.x += value.size();
+			}
+		}
+
+	private:
+		ea_t _fnc;
+		uint32_t _kinds;
+		const std::unordered_set<std::string_view>& _values;
+		std::vector<SearchIndex::Result>& _results;
+		YX _yx;
+};
+
+} // anonymous namespace
+
+void SearchIndex::add(ea_t fnc, const TokenSource& source, bool fromOutput)
+{
+	remove(fnc);
+
+	Indexer indexer;
+	if (source(fnc, indexer))
+	{
+		return;
+	}
+
+	uint32_t id = _fncs.size();
+	_fncs.push_back(fnc);
+	_fromOutput.push_back(fromOutput);
+	_ids[fnc] = id;
+	for (auto& t : indexer.terms)
+	{
+		auto& term = _terms[t.first];
+		term.kinds |= t.second;
+		term.fncs.push_back(id);
+	}
+}
+
+void SearchIndex::remove(ea_t fnc)
+{
+	auto it = _ids.find(fnc);
+	if (it == _ids.end())
+	{
+		return;
+	}
+
+	// Postings of the removed functions are dropped lazily.
+	_fncs[it->second] = BADADDR;
+	_ids.erase(it);
+	++_removed;
+	if (_removed > 1000 && _removed > _ids.size())
+	{
+		compact();
+	}
+}
+
+void SearchIndex::removeOutput()
+{
+	for (uint32_t id = 0; id < _fncs.size(); ++id)
+	{
+		if (_fromOutput[id] && _fncs[id] != BADADDR)
+		{
+			_ids.erase(_fncs[id]);
+			_fncs[id] = BADADDR;
+			++_removed;
+		}
+	}
+	compact();
+}
+
+bool SearchIndex::contains(ea_t fnc) const
+{
+	return _ids.count(fnc);
+}
+
+std::size_t SearchIndex::functions() const
+{
+	return _ids.size();
+}
+
+std::size_t SearchIndex::terms() const
+{
+	return _terms.size();
+}
+
+void SearchIndex::compact()
+{
+	std::vector<uint32_t> newIds(_fncs.size(), UINT32_MAX);
+	std::vector<ea_t> fncs;
+	std::vector<bool> fromOutput;
+	for (uint32_t id = 0; id < _fncs.size(); ++id)
+	{
+		if (_fncs[id] != BADADDR)
+		{
+			newIds[id] = fncs.size();
+			_ids[_fncs[id]] = fncs.size();
+			fncs.push_back(_fncs[id]);
+			fromOutput.push_back(_fromOutput[id]);
+		}
+	}
+
+	for (auto it = _terms.begin(); it != _terms.end(); )
+	{
+		auto& ids = it->second.fncs;
+		std::size_t n = 0;
+		for (auto id : ids)
+		{
+			if (newIds[id] != UINT32_MAX)
+			{
+				ids[n++] = newIds[id];
+			}
+		}
+		ids.resize(n);
+
+		// Kinds of the removed occurrences stay, they only make the
+		// pre-filtering less precise.
+		if (ids.empty())
+		{
+			it = _terms.erase(it);
+		}
+		else
+		{
+			ids.shrink_to_fit();
+			++it;
+		}
+	}
+
+	_fncs = std::move(fncs);
+	_fromOutput = std::move(fromOutput);
+	_removed = 0;
+}
+
+bool SearchIndex::search(
+		Query query,
+		const std::string& text,
+		const TokenSource& source,
+		std::size_t maxResults,
+		std::vector<Result>& results,
+		std::string& error) const
+{
+	results.clear();
+	uint32_t kinds = queryKinds(query);
+
+	std::unordered_set<std::string_view> values;
+	std::vector<uint32_t> ids;
+	if (query == Query::REGEX)
+	{
+		std::regex re;
+		try
+		{
+			re.assign(text, std::regex::ECMAScript | std::regex::optimize);
+		}
+		catch (const std::regex_error& e)
+		{
+			error = e.what();
+			return true;
+		}
+
+		// The dictionary is much smaller than the code.
+		for (auto& t : _terms)
+		{
+			if ((t.second.kinds & kinds) && std::regex_search(t.first, re))
+			{
+				values.insert(t.first);
+				ids.insert(ids.end(), t.second.fncs.begin(), t.second.fncs.end());
+			}
+		}
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	}
+	else
+	{
+		auto it = _terms.find(text);
+		if (it != _terms.end() && (it->second.kinds & kinds))
+		{
+			values.insert(it->first);
+			ids = it->second.fncs;
+		}
+	}
+
+	std::vector<ea_t> fncs;
+	for (auto id : ids)
+	{
+		if (_fncs[id] != BADADDR)
+		{
+			fncs.push_back(_fncs[id]);
+		}
+	}
+	std::sort(fncs.begin(), fncs.end());
+
+	for (auto fnc : fncs)
+	{
+		Scanner scanner(fnc, kinds, values, results);
+		source(fnc, scanner);
+		if (results.size() >= maxResults)
+		{
+			results.resize(maxResults);
+			break;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,94 @@
+
+#ifndef RETDEC_SEARCH_H
+#define RETDEC_SEARCH_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "token.h"
+#include "yx.h"
+
+/**
+ * Inverted index of the decompiled code - identifiers, literals, types,
+ * and comments (token values) -> functions containing them.
+ *
+ * Only functions are indexed, not the positions - they are found by
+ * scanning the tokens of the matching functions at query time. The index
+ * thus stays small even for tens of thousands of functions, and queries
+ * touch only the functions that contain the searched value.
+ */
+class SearchIndex
+{
+	public:
+		enum class Query
+		{
+			/// Identifiers (functions, variables, ...) equal to the text.
+			IDENTIFIER,
+			/// Literals equal to the text.
+			LITERAL,
+			/// Any indexed token matching the regular expression.
+			REGEX,
+		};
+
+		struct Result
+		{
+			/// Start of the function.
+			ea_t fnc = BADADDR;
+			YX yx;
+			ea_t ea = BADADDR;
+			Token::Kind kind = Token::Kind::NEW_LINE;
+			std::string value;
+		};
+
+	public:
+		/// (Re)index the function starting at \p fnc.
+		/// \p fromOutput marks functions indexed from a full decompilation.
+		void add(ea_t fnc, const TokenSource& source, bool fromOutput = false);
+		void remove(ea_t fnc);
+		/// Remove the functions indexed from a full decompilation.
+		void removeOutput();
+		bool contains(ea_t fnc) const;
+		/// Number of the indexed functions.
+		std::size_t functions() const;
+		/// Number of the distinct indexed values.
+		std::size_t terms() const;
+
+		/// Search for \p text, at most \p maxResults results sorted by
+		/// function and YX. \p source must give the same tokens as when
+		/// they were indexed.
+		/// Returns \c true if something went wrong (e.g. an invalid regular
+		/// expression), \p error is set then.
+		bool search(
+				Query query,
+				const std::string& text,
+				const TokenSource& source,
+				std::size_t maxResults,
+				std::vector<Result>& results,
+				std::string& error
+		) const;
+
+	private:
+		struct Term
+		{
+			/// Token kinds of the value (1 << kind).
+			uint32_t kinds = 0;
+			/// IDs of the functions, ascending.
+			std::vector<uint32_t> fncs;
+		};
+
+		void compact();
+
+	private:
+		std::unordered_map<std::string, Term> _terms;
+		/// Function ID -> start, BADADDR if removed.
+		std::vector<ea_t> _fncs;
+		std::vector<bool> _fromOutput;
+		/// Start -> ID of the live functions.
+		std::unordered_map<ea_t, uint32_t> _ids;
+		/// Number of the removed function IDs still in _terms.
+		std::size_t _removed = 0;
+};
+
+#endif
@@ -1,15 +1,19 @@
 
+#include <charconv>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <map>
 
 #include <lines.hpp>
 #include <pro.h>
 
-#include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
-
-#include <retdec/common/address.h>
+#include <rapidjson/filereadstream.h>
+#include <rapidjson/reader.h>
 
 #include "token.h"
+#include "tokenstream.h"
 
 std::map<Token::Kind, std::string> TokenColors =
 {
@@ -84,78 +88,352 @@ const std::string& Token::getColorTag() const
 	return TokenColors[kind];
 }
 
-std::vector<Token> parseTokens(const std::string& json, ea_t defaultEa)
+std::string symbolKey(Token::Kind kind, const std::string& value)
 {
-	std::vector<Token> res;
+	return char('0' + unsigned(kind)) + value;
+}
 
-	rapidjson::StringStream rss(json.c_str());
-	rapidjson::Document d;
-	rapidjson::ParseResult ok = d.ParseStream(rss);
-	if (!ok)
+namespace {
+
+const std::pair<const char*, Token::Kind> TokenKindJsonNames[] =
+{
+	{"nl", Token::Kind::NEW_LINE},
+	{"ws", Token::Kind::WHITE_SPACE},
+	{"punc", Token::Kind::PUNCTUATION},
+	{"op", Token::Kind::OPERATOR},
+	{"i_gvar", Token::Kind::ID_GVAR},
+	{"i_lvar", Token::Kind::ID_LVAR},
+	{"i_mem", Token::Kind::ID_MEM},
+	{"i_lab", Token::Kind::ID_LAB},
+	{"i_fnc", Token::Kind::ID_FNC},
+	{"i_arg", Token::Kind::ID_ARG},
+	{"keyw", Token::Kind::KEYWORD},
+	{"type", Token::Kind::TYPE},
+	{"preproc", Token::Kind::PREPROCESSOR},
+	{"inc", Token::Kind::INCLUDE},
+	{"l_bool", Token::Kind::LITERAL_BOOL},
+	{"l_int", Token::Kind::LITERAL_INT},
+	{"l_fp", Token::Kind::LITERAL_FP},
+	{"l_str", Token::Kind::LITERAL_STR},
+	{"l_sym", Token::Kind::LITERAL_SYM},
+	{"l_ptr", Token::Kind::LITERAL_PTR},
+	{"cmnt", Token::Kind::COMMENT},
+};
+
+/**
+ * Returns \c true if \p str is a known kind.
+ */
+bool parseKind(const char* str, std::size_t len, Token::Kind& kind)
+{
+	for (auto& k : TokenKindJsonNames)
 	{
-		std::string errMsg = GetParseError_En(ok.Code());
-		WARNING_GUI("Unable to parse decompilation output: "
-				<< errMsg << std::endl
-		);
-		return res;
+		if (std::strlen(k.first) == len && std::memcmp(k.first, str, len) == 0)
+		{
+			kind = k.second;
+			return true;
+		}
 	}
+	return false;
+}
 
-	auto tokens = d.FindMember("tokens");
-	if (tokens == d.MemberEnd() || !tokens->value.IsArray())
+/**
+ * Same as retdec::common::Address(str) - hexadecimal with the "0x" prefix,
+ * decimal otherwise - but without creating a string.
+ * Returns \c true if \p str is a valid address.
+ */
+bool parseAddress(const char* str, std::size_t len, ea_t& ea)
+{
+	int base = 10;
+	if (len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+	{
+		str += 2;
+		len -= 2;
+		base = 16;
+	}
+	uint64_t val = 0;
+	auto res = std::from_chars(str, str + len, val, base);
+	if (len == 0 || res.ec != std::errc() || res.ptr != str + len)
 	{
-		WARNING_GUI("Unable to parse tokens from decompilation output.\n");
-		return res;
+		return false;
 	}
+	ea = val;
+	return true;
+}
+
+/**
+ * RapidJSON SAX handler of RetDec's JSON output:
+ * \code{.json}
+ * { ..., "tokens": [ {"addr": "0x1000", "kind": "nl", "val": "\n"}, ... ] }
+ * \endcode
+ */
+class TokenHandler
+		: public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, TokenHandler>
+{
+	public:
+		TokenHandler(ea_t defaultEa, TokenSink& sink)
+				: _defaultEa(defaultEa)
+				, _ea(defaultEa)
+				, _sink(sink)
+		{
 
-	ea_t ea = defaultEa;
+		}
 
-	for (auto i = tokens->value.Begin(), e = tokens->value.End(); i != e; ++i)
-	{
-		auto& obj = *i;
-		if (obj.IsNull())
+		bool foundTokens() const
+		{
+			return _foundTokens;
+		}
+
+		bool StartObject()
+		{
+			++_depth;
+			if (inToken())
+			{
+				_hasKind = false;
+				_hasVal = false;
+			}
+			_key = Member::OTHER;
+			return true;
+		}
+
+		bool EndObject(rapidjson::SizeType)
+		{
+			if (inToken() && _hasKind && _hasVal)
+			{
+				_sink.token(_kind, _ea, _val);
+			}
+			--_depth;
+			_key = Member::OTHER;
+			return true;
+		}
+
+		bool StartArray()
+		{
+			++_depth;
+			if (_depth == tokensDepth && _key == Member::TOKENS)
+			{
+				_inTokens = true;
+				_foundTokens = true;
+			}
+			_key = Member::OTHER;
+			return true;
+		}
+
+		bool EndArray(rapidjson::SizeType)
+		{
+			if (_depth == tokensDepth)
+			{
+				_inTokens = false;
+			}
+			--_depth;
+			_key = Member::OTHER;
+			return true;
+		}
+
+		bool Key(const char* str, rapidjson::SizeType len, bool)
+		{
+			_key = Member::OTHER;
+			if (_depth == tokensDepth - 1 && isKey(str, len, "tokens"))
+			{
+				_key = Member::TOKENS;
+			}
+			else if (inToken())
+			{
+				if (isKey(str, len, "addr")) _key = Member::ADDR;
+				else if (isKey(str, len, "kind")) _key = Member::KIND;
+				else if (isKey(str, len, "val")) _key = Member::VAL;
+			}
+			return true;
+		}
+
+		bool String(const char* str, rapidjson::SizeType len, bool)
+		{
+			if (inToken())
+			{
+				switch (_key)
+				{
+					case Member::ADDR:
+						if (!parseAddress(str, len, _ea))
+						{
+							_ea = _defaultEa;
+						}
+						break;
+					case Member::KIND:
+						_hasKind = parseKind(str, len, _kind);
+						break;
+					case Member::VAL:
+						_val.assign(str, len);
+						_hasVal = true;
+						break;
+					default:
+						break;
+				}
+			}
+			_key = Member::OTHER;
+			return true;
+		}
+
+		bool Default()
+		{
+			_key = Member::OTHER;
+			return true;
+		}
+
+	private:
+		enum class Member
+		{
+			OTHER,
+			TOKENS,
+			ADDR,
+			KIND,
+			VAL,
+		};
+
+		/// Depth of the tokens array (the root object is 1).
+		inline static const unsigned tokensDepth = 2;
+
+		static bool isKey(const char* str, std::size_t len, const char* key)
 		{
-			continue;
+			return std::strlen(key) == len && std::memcmp(key, str, len) == 0;
 		}
 
-		auto addr = obj.FindMember("addr");
-		if (addr != obj.MemberEnd() && addr->value.IsString())
+		bool inToken() const
 		{
-			retdec::common::Address a(addr->value.GetString());
-			ea = a.isDefined() ? a.getValue() : defaultEa;
+			return _inTokens && _depth == tokensDepth + 1;
 		}
-		auto kind = obj.FindMember("kind");
-		auto val = obj.FindMember("val");
-		if (kind != obj.MemberEnd() && kind->value.IsString()
-				&& val != obj.MemberEnd() && val->value.IsString())
-		{
-			Token::Kind kk;
-			std::string k = kind->value.GetString();
-			if (k == "nl") kk = Token::Kind::NEW_LINE;
-			else if (k == "ws") kk = Token::Kind::WHITE_SPACE;
-			else if (k == "punc") kk = Token::Kind::PUNCTUATION;
-			else if (k == "op") kk = Token::Kind::OPERATOR;
-			else if (k == "i_gvar") kk = Token::Kind::ID_GVAR;
-			else if (k == "i_lvar") kk = Token::Kind::ID_LVAR;
-			else if (k == "i_mem") kk = Token::Kind::ID_MEM;
-			else if (k == "i_lab") kk = Token::Kind::ID_LAB;
-			else if (k == "i_fnc") kk = Token::Kind::ID_FNC;
-			else if (k == "i_arg") kk = Token::Kind::ID_ARG;
-			else if (k == "keyw") kk = Token::Kind::KEYWORD;
-			else if (k == "type") kk = Token::Kind::TYPE;
-			else if (k == "preproc") kk = Token::Kind::PREPROCESSOR;
-			else if (k == "inc") kk = Token::Kind::INCLUDE;
-			else if (k == "l_bool") kk = Token::Kind::LITERAL_BOOL;
-			else if (k == "l_int") kk = Token::Kind::LITERAL_INT;
-			else if (k == "l_fp") kk = Token::Kind::LITERAL_FP;
-			else if (k == "l_str") kk = Token::Kind::LITERAL_STR;
-			else if (k == "l_sym") kk = Token::Kind::LITERAL_SYM;
-			else if (k == "l_ptr") kk = Token::Kind::LITERAL_PTR;
-			else if (k == "cmnt") kk = Token::Kind::COMMENT;
-			else continue;
-
-			res.emplace_back(Token(kk, ea, val->value.GetString()));
+
+	private:
+		ea_t _defaultEa = BADADDR;
+		ea_t _ea = BADADDR;
+		TokenSink& _sink;
+
+		unsigned _depth = 0;
+		Member _key = Member::OTHER;
+		bool _inTokens = false;
+		bool _foundTokens = false;
+
+		bool _hasKind = false;
+		bool _hasVal = false;
+		Token::Kind _kind = Token::Kind::NEW_LINE;
+		std::string _val;
+};
+
+class VectorSink : public TokenSink
+{
+	public:
+		VectorSink(std::vector<Token>& tokens)
+				: _tokens(tokens)
+		{
+
+		}
+
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value) override
+		{
+			_tokens.emplace_back(kind, ea, value);
+		}
+
+	private:
+		std::vector<Token>& _tokens;
+};
+
+/**
+ * Parse RetDec's JSON output from \p stream (see TokenHandler).
+ * Returns \c true if something went wrong, \p error is set then.
+ */
+template <typename Stream>
+bool parseJsonTokens(
+		Stream& stream,
+		ea_t defaultEa,
+		TokenSink& sink,
+		std::string& error)
+{
+	TokenHandler handler(defaultEa, sink);
+	rapidjson::Reader reader;
+	rapidjson::ParseResult ok = reader.Parse(stream, handler);
+	if (!ok)
+	{
+		error = std::string("Unable to parse decompilation output: ")
+				+ GetParseError_En(ok.Code());
+		return true;
+	}
+	if (!handler.foundTokens())
+	{
+		error = "Unable to parse tokens from decompilation output.";
+		return true;
+	}
+	return false;
+}
+
+} // anonymous namespace
+
+bool tryParseTokens(
+		const std::string& output,
+		ea_t defaultEa,
+		TokenSink& sink,
+		std::string& error)
+{
+	if (TokenReader::isTokenStream(output.data(), output.size()))
+	{
+		TokenReader reader;
+		if (reader.open(output.data(), output.size(), defaultEa)
+				|| reader.read(sink))
+		{
+			error = "Unable to read tokens from decompilation output.";
+			return true;
 		}
+		return false;
+	}
+
+	rapidjson::StringStream rss(output.c_str());
+	return parseJsonTokens(rss, defaultEa, sink, error);
+}
+
+bool parseTokens(const std::string& output, ea_t defaultEa, TokenSink& sink)
+{
+	std::string error;
+	if (tryParseTokens(output, defaultEa, sink, error))
+	{
+		WARNING_GUI(error << std::endl);
+		return true;
+	}
+	return false;
+}
+
+bool parseTokensFile(const std::string& path, ea_t defaultEa, TokenSink& sink)
+{
+	FILE* fp = std::fopen(path.c_str(), "rb");
+	if (fp == nullptr)
+	{
+		WARNING_GUI("Unable to open decompilation output: " << path << std::endl);
+		return true;
+	}
+
+	std::string error;
+	std::vector<char> buffer(fileBufferSize);
+	rapidjson::FileReadStream frs(fp, buffer.data(), buffer.size());
+	bool failed = parseJsonTokens(frs, defaultEa, sink, error);
+	std::fclose(fp);
+
+	if (failed)
+	{
+		WARNING_GUI(error << std::endl);
 	}
+	return failed;
+}
+
+std::vector<Token> parseTokens(const std::string& output, ea_t defaultEa)
+{
+	std::vector<Token> res;
+	// A token takes ~40 B of JSON, and ~4 B of a token stream.
+	bool binary = TokenReader::isTokenStream(output.data(), output.size());
+	res.reserve(output.size() / (binary ? 4 : 40));
 
+	VectorSink sink(res);
+	if (parseTokens(output, defaultEa, sink))
+	{
+		res.clear();
+	}
 	return res;
 }
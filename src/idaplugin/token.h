@@ -2,7 +2,9 @@
 #ifndef RETDEC_TOKEN_H
 #define RETDEC_TOKEN_H
 
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "utils.h"
 
@@ -50,6 +52,67 @@ struct Token
 	const std::string& getColorTag() const;
 };
 
-std::vector<Token> parseTokens(const std::string& json, ea_t defaultEa);
+/**
+ * Key of a symbol (identifier) - its kind and value in one string, e.g.
+ * for hash maps.
+ */
+std::string symbolKey(Token::Kind kind, const std::string& value);
+
+/**
+ * Receives the tokens one by one, as they are parsed.
+ */
+class TokenSink
+{
+	public:
+		virtual ~TokenSink() = default;
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value
+		) = 0;
+};
+
+/**
+ * Feeds the tokens of the function starting at the given address into
+ * the sink, in the YX order.
+ * Returns \c true if something went wrong.
+ */
+using TokenSource = std::function<bool(ea_t, TokenSink&)>;
+
+/**
+ * Parse tokens from RetDec's JSON output, or from a binary token stream
+ * (see tokenstream.h), into \p sink. JSON is parsed as a stream (SAX), i.e.
+ * without building the JSON document. Tokens without an address get
+ * the address of the previous token, or \p defaultEa.
+ * Returns \c true if something went wrong - \p sink may have received
+ * some tokens even then.
+ */
+bool parseTokens(const std::string& output, ea_t defaultEa, TokenSink& sink);
+
+/**
+ * Same as parseTokens(), but \p error is set instead of reporting it. Does
+ * not use IDA's API - e.g. for decompilation workers.
+ */
+bool tryParseTokens(
+		const std::string& output,
+		ea_t defaultEa,
+		TokenSink& sink,
+		std::string& error
+);
+
+inline const std::size_t fileBufferSize = 64 * 1024;
+
+/**
+ * Same as parseTokens(), but RetDec's JSON output is streamed from the file
+ * \p path through a buffer of fileBufferSize bytes - i.e. the output is
+ * never in memory as a whole.
+ */
+bool parseTokensFile(const std::string& path, ea_t defaultEa, TokenSink& sink);
+
+/**
+ * Parse all the tokens from RetDec's JSON output, or from a binary token
+ * stream. Returns an empty vector if something went wrong.
+ */
+std::vector<Token> parseTokens(const std::string& output, ea_t defaultEa);
 
 #endif
@@ -0,0 +1,206 @@
+
+#include <cstring>
+#include <limits>
+
+#include "tokenstream.h"
+
+namespace {
+
+const char magic[] = {'R', 'D', 'T', 'K'};
+const uint64_t undefinedEa = std::numeric_limits<uint64_t>::max();
+
+void writeVarint(std::string& out, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		out += char((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	out += char(v);
+}
+
+void writeSvarint(std::string& out, int64_t v)
+{
+	writeVarint(out, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool readVarint(const char*& pos, const char* end, uint64_t& v)
+{
+	v = 0;
+	for (unsigned shift = 0; pos < end && shift < 64; shift += 7)
+	{
+		auto b = uint8_t(*pos++);
+		v |= uint64_t(b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool readSvarint(const char*& pos, const char* end, int64_t& v)
+{
+	uint64_t u = 0;
+	if (readVarint(pos, end, u))
+	{
+		return true;
+	}
+	v = int64_t(u >> 1) ^ -int64_t(u & 1);
+	return false;
+}
+
+} // anonymous namespace
+
+//
+//==============================================================================
+// TokenWriter
+//==============================================================================
+//
+
+void TokenWriter::token(Token::Kind kind, ea_t ea, const std::string& value)
+{
+	auto it = _stringIds.find(value);
+	if (it == _stringIds.end())
+	{
+		it = _stringIds.emplace(value, _strings.size()).first;
+		_strings.push_back(&it->first);
+	}
+
+	uint64_t a = ea == BADADDR ? undefinedEa : uint64_t(ea);
+	_tokens += char(kind);
+	writeSvarint(_tokens, int64_t(a - _ea));
+	writeVarint(_tokens, it->second);
+
+	_ea = a;
+	++_size;
+}
+
+std::size_t TokenWriter::size() const
+{
+	return _size;
+}
+
+std::string TokenWriter::finish()
+{
+	std::string out(magic, sizeof(magic));
+	out += char(TokenReader::version);
+	writeVarint(out, _strings.size());
+	writeVarint(out, _size);
+	for (auto* s : _strings)
+	{
+		writeVarint(out, s->size());
+		out += *s;
+	}
+	out += _tokens;
+
+	*this = TokenWriter();
+	return out;
+}
+
+//
+//==============================================================================
+// TokenReader
+//==============================================================================
+//
+
+bool TokenReader::isTokenStream(const char* data, std::size_t size)
+{
+	return size > sizeof(magic) && std::memcmp(data, magic, sizeof(magic)) == 0;
+}
+
+bool TokenReader::open(const char* data, std::size_t size, ea_t defaultEa)
+{
+	*this = TokenReader();
+	if (!isTokenStream(data, size) || uint8_t(data[sizeof(magic)]) != version)
+	{
+		return true;
+	}
+	_pos = data + sizeof(magic) + 1;
+	_end = data + size;
+	_defaultEa = defaultEa;
+
+	uint64_t strings = 0;
+	uint64_t tokens = 0;
+	if (readVarint(_pos, _end, strings)
+			|| readVarint(_pos, _end, tokens)
+			// Each string takes at least one byte, each token three.
+			|| strings > std::size_t(_end - _pos)
+			|| tokens > std::size_t(_end - _pos) / 3)
+	{
+		return true;
+	}
+
+	_strings.reserve(strings);
+	for (uint64_t i = 0; i < strings; ++i)
+	{
+		uint64_t len = 0;
+		if (readVarint(_pos, _end, len) || len > std::size_t(_end - _pos))
+		{
+			return true;
+		}
+		_strings.emplace_back(_pos, len);
+		_pos += len;
+	}
+	_size = tokens;
+
+	return false;
+}
+
+std::size_t TokenReader::size() const
+{
+	return _size;
+}
+
+std::size_t TokenReader::strings() const
+{
+	return _strings.size();
+}
+
+bool TokenReader::next(Token::Kind& kind, ea_t& ea, std::string_view& value)
+{
+	if (_read >= _size || _corrupted)
+	{
+		return false;
+	}
+
+	uint8_t k = 0;
+	int64_t delta = 0;
+	uint64_t str = 0;
+	if (_pos >= _end
+			|| (k = uint8_t(*_pos++)) > uint8_t(Token::Kind::COMMENT)
+			|| readSvarint(_pos, _end, delta)
+			|| readVarint(_pos, _end, str)
+			|| str >= _strings.size())
+	{
+		_corrupted = true;
+		return false;
+	}
+
+	_ea += uint64_t(delta);
+	kind = Token::Kind(k);
+	ea = _ea == undefinedEa ? _defaultEa : ea_t(_ea);
+	value = _strings[str];
+	++_read;
+	return true;
+}
+
+bool TokenReader::read(TokenSink& sink)
+{
+	Token::Kind kind;
+	ea_t ea;
+	std::string_view value;
+	std::string buffer;
+	while (next(kind, ea, value))
+	{
+		buffer.assign(value.data(), value.size());
+		sink.token(kind, ea, buffer);
+	}
+	return _corrupted || _read != _size || _pos != _end;
+}
@@ -0,0 +1,91 @@
+
+#ifndef RETDEC_TOKENSTREAM_H
+#define RETDEC_TOKENSTREAM_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "token.h"
+
+/**
+ * Compact binary token stream - for storing decompiled functions and
+ * passing them between processes. Several times smaller than RetDec's JSON
+ * output, and read without parsing.
+ *
+ * Layout (varint = unsigned LEB128, svarint = zig-zag varint):
+ * \code
+ * "RDTK" u8:version
+ * varint:#strings varint:#tokens
+ * strings: { varint:size bytes }...    - every distinct token value once
+ * tokens:  { u8:kind svarint:address-delta varint:string-index }...
+ * \endcode
+ * Address deltas are to the previous token's address (the first token's
+ * to 0). Undefined addresses (BADADDR) are stored as UINT64_MAX, so the
+ * stream is the same for 32-bit and 64-bit address spaces.
+ */
+class TokenWriter : public TokenSink
+{
+	public:
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value
+		) override;
+
+		/// Number of the tokens so far.
+		std::size_t size() const;
+		/// The serialized stream. The writer is empty afterwards.
+		std::string finish();
+
+	private:
+		std::unordered_map<std::string, uint64_t> _stringIds;
+		std::vector<const std::string*> _strings;
+		std::string _tokens;
+		uint64_t _ea = 0;
+		std::size_t _size = 0;
+};
+
+/**
+ * Reader of a token stream in memory (e.g. mmap'd). Nothing is copied -
+ * token values are views into the buffer, which must outlive the reader.
+ */
+class TokenReader
+{
+	public:
+		inline static const uint8_t version = 1;
+
+		/// Is \p data a token stream (of any version)?
+		static bool isTokenStream(const char* data, std::size_t size);
+
+		/// Undefined addresses are read as \p defaultEa.
+		/// Returns \c true if something went wrong - i.e. not a token
+		/// stream, an unsupported version, or a truncated stream.
+		bool open(const char* data, std::size_t size, ea_t defaultEa = BADADDR);
+
+		/// Number of the tokens.
+		std::size_t size() const;
+		/// Number of the distinct token values.
+		std::size_t strings() const;
+
+		/// Read the next token.
+		/// Returns \c false at the end of the stream, or if it is corrupted.
+		bool next(Token::Kind& kind, ea_t& ea, std::string_view& value);
+		/// Read all the remaining tokens into \p sink.
+		/// Returns \c true if something went wrong.
+		bool read(TokenSink& sink);
+
+	private:
+		const char* _pos = nullptr;
+		const char* _end = nullptr;
+		ea_t _defaultEa = BADADDR;
+		uint64_t _ea = 0;
+		std::size_t _size = 0;
+		std::size_t _read = 0;
+		bool _corrupted = false;
+		std::vector<std::string_view> _strings;
+};
+
+#endif
@@ -1,4 +1,8 @@
 
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
 #include "config.h"
 #include "place.h"
 #include "retdec.h"
@@ -27,6 +31,188 @@ action_state_t idaapi fullDecompilation_ah_t::update(action_update_ctx_t*)
 	return AST_ENABLE_ALWAYS;
 }
 
+//
+//==============================================================================
+// openOutput_ah_t
+//==============================================================================
+//
+
+openOutput_ah_t::openOutput_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi openOutput_ah_t::activate(action_activation_ctx_t*)
+{
+	char* path = ask_file(
+			false,                       // bool for_saving
+			"*.rdtk",                    // const char *default_answer
+			"%s",                        // const char *format
+			"Open decompiled output"
+	);
+	if (path != nullptr)
+	{
+		plg.openDecompiledOutput(path);
+	}
+	return false;
+}
+
+action_state_t idaapi openOutput_ah_t::update(action_update_ctx_t*)
+{
+	return AST_ENABLE_ALWAYS;
+}
+
+//
+//==============================================================================
+// CodeLocations
+//==============================================================================
+//
+
+namespace {
+
+/**
+ * Non-modal list of places in the decompiled code (e.g. search results),
+ * Enter shows the place in the RetDec viewer.
+ */
+class CodeLocations : public chooser_t
+{
+	public:
+		CodeLocations(
+				RetDec& plg,
+				const std::string& title,
+				std::vector<SearchIndex::Result>&& results)
+				: chooser_t(0, qnumber(widths), widths, header)
+				, _plg(plg)
+				, _title(title)
+				, _results(std::move(results))
+		{
+			title = _title.c_str();
+		}
+
+		virtual size_t idaapi get_count() const override
+		{
+			return _results.size();
+		}
+
+		virtual void idaapi get_row(
+				qstrvec_t* cols,
+				int*,
+				chooser_item_attrs_t*,
+				size_t n) const override
+		{
+			auto& r = _results[n];
+			get_func_name(&cols->at(0), r.fnc);
+			cols->at(1).sprnt("%zu:%zu", r.yx.y, r.yx.x);
+			cols->at(2) = Token(r.kind, r.ea, r.value).getKindString().c_str();
+			cols->at(3) = r.value.c_str();
+			cols->at(4).sprnt("%a", r.ea);
+		}
+
+		virtual ea_t idaapi get_ea(size_t n) const override
+		{
+			return _results[n].ea;
+		}
+
+		virtual cbret_t idaapi enter(size_t n) override
+		{
+			auto& r = _results[n];
+			auto* f = _plg.selectiveDecompilationAndDisplay(r.fnc, false);
+			if (f)
+			{
+				retdec_place_t place(f, r.yx);
+				jumpto(_plg.custViewer, &place, place.x(), place.y());
+			}
+			return cbret_t();
+		}
+
+	private:
+		inline static const int widths[] = {24, 8, 10, 32, 16};
+		inline static const char* const header[] =
+				{"Function", "Line", "Kind", "Value", "Address"};
+
+		RetDec& _plg;
+		std::string _title;
+		std::vector<SearchIndex::Result> _results;
+};
+
+} // anonymous namespace
+
+//
+//==============================================================================
+// search_ah_t
+//==============================================================================
+//
+
+search_ah_t::search_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi search_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	static const char form[] =
+			"Search decompiled code (RetDec)\n"
+			"\n"
+			"<~T~ext:q:1023:60::>\n"
+			"<~I~dentifier:R>\n"
+			"<~L~iteral:R>\n"
+			"<~R~egular expression:R>>\n";
+
+	// The token under the cursor is the most likely query.
+	qstring text;
+	auto* place = ctx->widget == plg.custViewer
+			? dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+					ctx->widget,
+					false, // mouse
+					nullptr, // x
+					nullptr // y
+			))
+			: nullptr;
+	auto* token = place ? place->token() : nullptr;
+	if (token && token->kind != Token::Kind::WHITE_SPACE
+			&& token->kind != Token::Kind::NEW_LINE)
+	{
+		text = token->value.c_str();
+	}
+
+	ushort query = 0;
+	if (ask_form(form, &text, &query) != 1 || text.empty())
+	{
+		return false;
+	}
+
+	std::vector<SearchIndex::Result> results;
+	if (plg.searchDecompiledCode(
+			query == 0 ? SearchIndex::Query::IDENTIFIER
+			: query == 1 ? SearchIndex::Query::LITERAL
+			: SearchIndex::Query::REGEX,
+			text.c_str(),
+			results))
+	{
+		return false;
+	}
+	if (results.empty())
+	{
+		INFO_MSG("No decompiled code matches " << text.c_str() << "\n");
+		return false;
+	}
+
+	// Non-modal choosers are deleted by IDA when closed.
+	(new CodeLocations(
+			plg,
+			std::string("RetDec search: ") + text.c_str(),
+			std::move(results)
+	))->choose();
+	return false;
+}
+
+action_state_t idaapi search_ah_t::update(action_update_ctx_t*)
+{
+	return AST_ENABLE_ALWAYS;
+}
+
 //
 //==============================================================================
 // jump2asm_ah_t
@@ -68,6 +254,108 @@ action_state_t idaapi jump2asm_ah_t::update(action_update_ctx_t* ctx)
 //==============================================================================
 //
 
+namespace {
+
+const char* copy2asmQuestion = "Copying pseudocode to disassembly"
+		" will destroy existing comments.\n"
+		"Do you want to continue?";
+
+/**
+ * Writes the lines of decompiled functions into anterior comments as
+ * the tokens come - neither the tokens nor the lines are collected, only
+ * the number of lines of each address of the current function. Existing
+ * comments of an address are deleted once, before its first line, and all
+ * its lines are written in order.
+ */
+class AsmCommentWriter : public TokenSink
+{
+	public:
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value) override
+		{
+			// The line's address is the address of its first token.
+			if (_lineStart)
+			{
+				_lineEa = ea;
+				_lineStart = false;
+			}
+
+			if (kind == Token::Kind::NEW_LINE)
+			{
+				writeLine();
+			}
+			else
+			{
+				_line += value;
+			}
+		}
+
+		/// Forget the current function's addresses, warn about addresses
+		/// with more lines than IDA can hold in their anterior comments.
+		/// Returns the number of the written lines.
+		std::size_t endFunction()
+		{
+			for (auto& d : _dropped)
+			{
+				WARNING_MSG("Pseudocode of " << std::hex << d.first
+						<< std::dec << " has more than "
+						<< E_NEXT - E_PREV << " lines, " << d.second
+						<< " line(s) were not copied.\n");
+			}
+			_line.clear();
+			_lineStart = true;
+			_lines.clear();
+			_dropped.clear();
+			auto written = _written;
+			_written = 0;
+			return written;
+		}
+
+	private:
+		void writeLine()
+		{
+			if (_lineEa != BADADDR)
+			{
+				auto& n = _lines[_lineEa];
+				if (n == 0)
+				{
+					delete_extra_cmts(_lineEa, E_PREV);
+				}
+				if (n < E_NEXT - E_PREV)
+				{
+					// An empty line would end the comment.
+					update_extra_cmt(
+							_lineEa,
+							E_PREV + n,
+							_line.empty() ? " " : _line.c_str()
+					);
+					++n;
+					++_written;
+				}
+				else
+				{
+					++_dropped[_lineEa];
+				}
+			}
+			_line.clear();
+			_lineStart = true;
+		}
+
+	private:
+		std::string _line;
+		ea_t _lineEa = BADADDR;
+		bool _lineStart = true;
+		/// Address -> number of its lines written so far.
+		std::unordered_map<ea_t, int> _lines;
+		/// Address -> number of its lines that did not fit.
+		std::map<ea_t, std::size_t> _dropped;
+		std::size_t _written = 0;
+};
+
+} // anonymous namespace
+
 copy2asm_ah_t::copy2asm_ah_t(RetDec& p)
 		: plg(p)
 {
@@ -76,20 +364,19 @@ copy2asm_ah_t::copy2asm_ah_t(RetDec& p)
 
 int idaapi copy2asm_ah_t::activate(action_activation_ctx_t*)
 {
-	static const char* text = "Copying pseudocode to disassembly"
-			" will destroy existing comments.\n"
-			"Do you want to continue?";
-	if (ask_yn(ASKBTN_NO, text) == ASKBTN_YES)
+	if (ask_yn(ASKBTN_NO, copy2asmQuestion) == ASKBTN_YES)
 	{
-		for (auto& p : plg.fnc->toLines())
+		AsmCommentWriter writer;
+		bool failed = plg.readFunctionTokens(plg.fnc->getStart(), writer);
+		writer.endFunction();
+		if (failed)
 		{
-			ea_t addr = p.second;
-			auto& line = p.first;
-
-			delete_extra_cmts(addr, E_PREV);
-			bool anteriorCmt = true;
-			add_extra_cmt(addr, anteriorCmt, "%s", line.c_str());
+			WARNING_MSG("Function " << plg.fnc->getName() << " is not"
+					" decompiled yet, decompile it first.\n"
+			);
+			return false;
 		}
+		request_refresh(IWID_DISASMS);
 
 		// Focus to IDA view.
 		auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
@@ -112,6 +399,148 @@ action_state_t idaapi copy2asm_ah_t::update(action_update_ctx_t* ctx)
 			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
 }
 
+//
+//==============================================================================
+// copy2asmFunctions_ah_t
+//==============================================================================
+//
+
+copy2asmFunctions_ah_t::copy2asmFunctions_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi copy2asmFunctions_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	if (ask_yn(ASKBTN_NO, copy2asmQuestion) != ASKBTN_YES)
+	{
+		return false;
+	}
+
+	// Functions are streamed one by one from the cache or the opened full
+	// decompilation - the memory does not grow with the selection.
+	AsmCommentWriter writer;
+	std::size_t copied = 0;
+	std::size_t lines = 0;
+	std::size_t skipped = 0;
+	show_wait_box("Copying pseudocode to disassembly...");
+	for (auto n : ctx->chooser_selection)
+	{
+		if (user_cancelled())
+		{
+			break;
+		}
+
+		func_t* f = getn_func(n);
+		if (f == nullptr)
+		{
+			continue;
+		}
+		if (plg.readFunctionTokens(f->start_ea, writer))
+		{
+			++skipped;
+		}
+		else
+		{
+			++copied;
+		}
+		lines += writer.endFunction();
+	}
+	hide_wait_box();
+	request_refresh(IWID_DISASMS);
+
+	INFO_MSG("Copied " << lines << " line(s) of " << copied
+			<< " function(s) to disassembly.\n"
+	);
+	if (skipped)
+	{
+		WARNING_MSG(skipped << " function(s) are not decompiled yet,"
+				" decompile them first.\n"
+		);
+	}
+	return false;
+}
+
+action_state_t idaapi copy2asmFunctions_ah_t::update(
+		action_update_ctx_t* ctx)
+{
+	return ctx->widget_type == BWN_FUNCS
+			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+}
+
+//
+//==============================================================================
+// nextOccurrence_ah_t
+//==============================================================================
+//
+
+nextOccurrence_ah_t::nextOccurrence_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi nextOccurrence_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+			ctx->widget,
+			false, // mouse
+			nullptr, // x
+			nullptr // y
+	));
+	if (place == nullptr)
+	{
+		return false;
+	}
+
+	retdec_place_t next(place->fnc(), place->fnc()->next_occurrence(place->yx()));
+	jumpto(plg.custViewer, &next, next.x(), next.y());
+	return false;
+}
+
+action_state_t idaapi nextOccurrence_ah_t::update(action_update_ctx_t* ctx)
+{
+	return ctx->widget == plg.custViewer
+			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+}
+
+//
+//==============================================================================
+// prevOccurrence_ah_t
+//==============================================================================
+//
+
+prevOccurrence_ah_t::prevOccurrence_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi prevOccurrence_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+			ctx->widget,
+			false, // mouse
+			nullptr, // x
+			nullptr // y
+	));
+	if (place == nullptr)
+	{
+		return false;
+	}
+
+	retdec_place_t prev(place->fnc(), place->fnc()->prev_occurrence(place->yx()));
+	jumpto(plg.custViewer, &prev, prev.x(), prev.y());
+	return false;
+}
+
+action_state_t idaapi prevOccurrence_ah_t::update(action_update_ctx_t* ctx)
+{
+	return ctx->widget == plg.custViewer
+			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+}
+
 //
 //==============================================================================
 // funcComment_ah_t
@@ -229,6 +658,120 @@ action_state_t idaapi renameGlobalObj_ah_t::update(action_update_ctx_t* ctx)
 			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
 }
 
+//
+//==============================================================================
+// renameLocal_ah_t
+//==============================================================================
+//
+
+namespace {
+
+/// Number of the lines shown in the rename preview.
+const std::size_t renamePreviewLines = 5;
+
+/**
+ * Text of the line \p y of \p fnc, without the indentation.
+ */
+std::string lineText(const Function& fnc, std::size_t y)
+{
+	std::string text;
+	auto& tokens = fnc.getTokens();
+	for (auto it = tokens.lower_bound(YX(y, YX::starting_x));
+			it != tokens.end() && it->first.y == y;
+			++it)
+	{
+		if (it->second.kind == Token::Kind::NEW_LINE
+				|| (text.empty() && it->second.kind == Token::Kind::WHITE_SPACE))
+		{
+			continue;
+		}
+		text += it->second.value;
+	}
+	return text;
+}
+
+} // anonymous namespace
+
+renameLocal_ah_t::renameLocal_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi renameLocal_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+			ctx->widget,
+			false, // mouse
+			nullptr, // x
+			nullptr // y
+	));
+	auto* token = place ? place->token() : nullptr;
+	if (token == nullptr
+			|| (token->kind != Token::Kind::ID_LVAR
+					&& token->kind != Token::Kind::ID_ARG))
+	{
+		return false;
+	}
+	Function* fnc = place->fnc();
+	auto kind = token->kind;
+	std::string oldName = token->value;
+
+	// Preview of the changed lines - straight from the occurrences.
+	auto& occurrences = fnc->getOccurrences(kind, oldName);
+	std::stringstream preview;
+	preview << "Please enter variable name - " << occurrences.size()
+			<< " occurrence(s):";
+	std::size_t lines = 0;
+	std::size_t lastY = 0;
+	for (auto& yx : occurrences)
+	{
+		if (yx.y == lastY)
+		{
+			continue;
+		}
+		lastY = yx.y;
+		if (++lines > renamePreviewLines)
+		{
+			preview << "\n...";
+			break;
+		}
+		preview << "\n" << yx.y << ": " << lineText(*fnc, yx.y);
+	}
+
+	qstring qNewName = oldName.c_str();
+	if (!ask_str(&qNewName, HIST_IDENT, "%s", preview.str().c_str())
+			|| qNewName.empty())
+	{
+		return false;
+	}
+	std::string newName = qNewName.c_str();
+	if (newName == oldName)
+	{
+		return false;
+	}
+	if (!fnc->getOccurrences(Token::Kind::ID_LVAR, newName).empty()
+			|| !fnc->getOccurrences(Token::Kind::ID_ARG, newName).empty())
+	{
+		WARNING_GUI("Variable " << newName << " already exists in "
+				<< fnc->getName() << ".\n"
+		);
+		return false;
+	}
+
+	// Only in the decompiled code, IDA has no such variable.
+	plg.modifyFunction(fnc->fnc(), kind, oldName, newName);
+	refresh_custom_viewer(plg.custViewer);
+
+	return false;
+}
+
+action_state_t idaapi renameLocal_ah_t::update(action_update_ctx_t* ctx)
+{
+	return ctx->widget == plg.custViewer
+			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+}
+
 //
 //==============================================================================
 // openXrefs_ah_t
@@ -279,6 +822,71 @@ action_state_t idaapi openXrefs_ah_t::update(action_update_ctx_t* ctx)
 			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
 }
 
+//
+//==============================================================================
+// pseudocodeXrefs_ah_t
+//==============================================================================
+//
+
+pseudocodeXrefs_ah_t::pseudocodeXrefs_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi pseudocodeXrefs_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+			ctx->widget,
+			false, // mouse
+			nullptr, // x
+			nullptr // y
+	));
+	auto* token = place ? place->token() : nullptr;
+	if (token == nullptr || !XrefGraph::isReference(token->kind))
+	{
+		return false;
+	}
+
+	std::vector<XrefGraph::Xref> xrefs;
+	if (plg.findPseudocodeXrefs(token->kind, token->value, xrefs))
+	{
+		return false;
+	}
+	if (xrefs.empty())
+	{
+		INFO_MSG("No decompiled code refers to " << token->value << "\n");
+		return false;
+	}
+
+	std::vector<SearchIndex::Result> results;
+	results.reserve(xrefs.size());
+	for (auto& x : xrefs)
+	{
+		SearchIndex::Result r;
+		r.fnc = x.fnc;
+		r.yx = x.yx;
+		r.ea = x.ea;
+		r.kind = token->kind;
+		r.value = token->value;
+		results.push_back(std::move(r));
+	}
+
+	// Non-modal choosers are deleted by IDA when closed.
+	(new CodeLocations(
+			plg,
+			"RetDec xrefs to " + token->value,
+			std::move(results)
+	))->choose();
+	return false;
+}
+
+action_state_t idaapi pseudocodeXrefs_ah_t::update(action_update_ctx_t* ctx)
+{
+	return ctx->widget == plg.custViewer
+			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+}
+
 //
 //==============================================================================
 // openCalls_ah_t
@@ -405,12 +1013,155 @@ action_state_t idaapi changeFuncType_ah_t::update(action_update_ctx_t* ctx)
 			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
 }
 
+//
+//==============================================================================
+// profileDecompilation_ah_t
+//==============================================================================
+//
+
+profileDecompilation_ah_t::profileDecompilation_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi profileDecompilation_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	auto* place = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
+			ctx->widget,
+			false, // mouse
+			nullptr, // x
+			nullptr // y
+	));
+	if (place == nullptr)
+	{
+		return false;
+	}
+
+	if (RetDec::profiles.empty())
+	{
+		WARNING_GUI("There are no decompilation profiles.\n");
+		return false;
+	}
+
+	auto names = profileNames(RetDec::profiles);
+	qstring qProfile = RetDec::options.selectiveProfile.c_str();
+	if (!ask_str(&qProfile, HIST_IDENT, "Decompilation profile (%s):",
+			names.c_str())
+			|| qProfile.empty())
+	{
+		return false;
+	}
+
+	std::string profile = qProfile.c_str();
+	if (RetDec::profiles.count(profile) == 0)
+	{
+		WARNING_GUI("Unknown decompilation profile: " << profile << "\n"
+				<< "Available profiles: " << names
+		);
+		return false;
+	}
+
+	plg.selectiveDecompilationAndDisplay(place->toea(), true, &profile);
+	return false;
+}
+
+action_state_t idaapi profileDecompilation_ah_t::update(action_update_ctx_t* ctx)
+{
+	return ctx->widget == plg.custViewer
+			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+}
+
+//
+//==============================================================================
+// backgroundDecompilation_ah_t
+//==============================================================================
+//
+
+backgroundDecompilation_ah_t::backgroundDecompilation_ah_t(RetDec& p)
+		: plg(p)
+{
+
+}
+
+int idaapi backgroundDecompilation_ah_t::activate(action_activation_ctx_t* ctx)
+{
+	std::vector<func_t*> fncs;
+	for (auto n : ctx->chooser_selection)
+	{
+		if (func_t* f = getn_func(n))
+		{
+			fncs.push_back(f);
+		}
+	}
+
+	plg.backgroundDecompilation(fncs);
+	return false;
+}
+
+action_state_t idaapi backgroundDecompilation_ah_t::update(
+		action_update_ctx_t* ctx)
+{
+	return ctx->widget_type == BWN_FUNCS
+			? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+}
+
 //
 //==============================================================================
 // on_event
 //==============================================================================
 //
 
+namespace {
+
+/**
+ * Highlight the occurrences of the identifier under the cursor \p cur on
+ * the rendered lines - each line costs only a lookup in the occurrences,
+ * the tokens are not scanned.
+ */
+void highlightOccurrences(
+		const retdec_place_t& cur,
+		lines_rendering_input_t* info,
+		lines_rendering_output_t* out)
+{
+	auto* fnc = cur.fnc();
+	auto* token = cur.token();
+	if (token == nullptr)
+	{
+		return;
+	}
+	auto& occ = fnc->getOccurrences(token->kind, token->value);
+	if (occ.empty())
+	{
+		return;
+	}
+
+	for (auto& sl : info->sections_lines)
+	for (auto& l : sl)
+	{
+		auto* p = dynamic_cast<const retdec_place_t*>(l->at);
+		if (p == nullptr || p->fnc() != fnc)
+		{
+			continue;
+		}
+
+		auto it = std::lower_bound(occ.begin(), occ.end(), YX(p->y(), 0));
+		for (; it != occ.end() && it->y == p->y(); ++it)
+		{
+			auto* e = new line_rendering_output_entry_t(
+					l,
+					LROEF_CPS_RANGE,
+					0xff000000 + 0x00ffff
+			);
+			e->cpx = it->x;
+			e->nchars = token->value.size();
+			out->entries.push_back(e);
+		}
+	}
+}
+
+} // anonymous namespace
+
 /**
  * User interface hook.
  */
@@ -425,6 +1176,20 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 			// Continue only if event was triggered in our widget.
 			TWidget* view = va_arg(va, TWidget*);
 			TPopupMenu* popup = va_arg(va, TPopupMenu*);
+			if (get_widget_type(view) == BWN_FUNCS)
+			{
+				attach_action_to_popup(
+						view,
+						popup,
+						backgroundDecompilation_ah_t::actionName
+				);
+				attach_action_to_popup(
+						view,
+						popup,
+						copy2asmFunctions_ah_t::actionName
+				);
+				return false;
+			}
 			if (view != custViewer && view != codeViewer)
 			{
 				return false;
@@ -447,6 +1212,30 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 				return false;
 			}
 
+			if (Function::isIdentifier(token->kind))
+			{
+				if (token->kind == Token::Kind::ID_LVAR
+						|| token->kind == Token::Kind::ID_ARG)
+				{
+					attach_action_to_popup(
+							view,
+							popup,
+							renameLocal_ah_t::actionName
+					);
+				}
+				attach_action_to_popup(
+						view,
+						popup,
+						nextOccurrence_ah_t::actionName
+				);
+				attach_action_to_popup(
+						view,
+						popup,
+						prevOccurrence_ah_t::actionName
+				);
+				attach_action_to_popup(view, popup, "-");
+			}
+
 			func_t* tfnc = nullptr;
 			if (token->kind == Token::Kind::ID_FNC
 					&& (tfnc = getIdaFunction(token->value)))
@@ -461,6 +1250,11 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 						popup,
 						openXrefs_ah_t::actionName
 				);
+				attach_action_to_popup(
+						view,
+						popup,
+						pseudocodeXrefs_ah_t::actionName
+				);
 				attach_action_to_popup(
 						view,
 						popup,
@@ -490,6 +1284,20 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 						popup,
 						openXrefs_ah_t::actionName
 				);
+				attach_action_to_popup(
+						view,
+						popup,
+						pseudocodeXrefs_ah_t::actionName
+				);
+				attach_action_to_popup(view, popup, "-");
+			}
+			else if (token->kind == Token::Kind::ID_MEM)
+			{
+				attach_action_to_popup(
+						view,
+						popup,
+						pseudocodeXrefs_ah_t::actionName
+				);
 				attach_action_to_popup(view, popup, "-");
 			}
 
@@ -508,6 +1316,16 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 					popup,
 					funcComment_ah_t::actionName
 			);
+			attach_action_to_popup(
+					view,
+					popup,
+					profileDecompilation_ah_t::actionName
+			);
+			attach_action_to_popup(
+					view,
+					popup,
+					search_ah_t::actionName
+			);
 
 			break;
 		}
@@ -515,12 +1333,6 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 
 		case ui_get_lines_rendering_info:
 		{
-			auto* demoSyncGroup = get_synced_group(custViewer);
-			if (demoSyncGroup == nullptr)
-			{
-				return false;
-			}
-
 			auto* demoPlace = dynamic_cast<retdec_place_t*>(get_custom_viewer_place(
 					custViewer,
 					false, // mouse
@@ -531,16 +1343,24 @@ ssize_t idaapi RetDec::on_event(ssize_t code, va_list va)
 			{
 				return false;
 			}
-			auto eas = demoPlace->fnc()->yx_2_eas(demoPlace->yx());
 
 			lines_rendering_output_t* out = va_arg(va, lines_rendering_output_t*);
 			TWidget* view = va_arg(va, TWidget*);
 			lines_rendering_input_t* info = va_arg(va, lines_rendering_input_t*);
 
-			if (view == nullptr || info->sync_group != demoSyncGroup)
+			if (view != nullptr && view == custViewer)
+			{
+				highlightOccurrences(*demoPlace, info, out);
+			}
+
+			auto* demoSyncGroup = get_synced_group(custViewer);
+			if (view == nullptr
+					|| demoSyncGroup == nullptr
+					|| info->sync_group != demoSyncGroup)
 			{
 				return false;
 			}
+			auto eas = demoPlace->fnc()->yx_2_eas(demoPlace->yx());
 
 			for (auto& sl : info->sections_lines)
 			for (auto& l : sl)
@@ -669,6 +1489,18 @@ void idaapi cv_location_changed(
 		retdec_place_t max(newp->fnc(), newp->fnc()->max_yx());
 		set_custom_viewer_range(ctx->custViewer, &min, &max);
 		ctx->fnc = newp->fnc();
+
+		// A place restored from the IDB (e.g. history) of a function which
+		// is not decompiled yet - see RetDec::refineFunction().
+		ea_t start = newp->fnc()->getStart();
+		func_t* f = get_func(start);
+		if (retdec_place_t::isPlaceholder(newp->fnc())
+				&& f != nullptr
+				&& f->start_ea == start
+				&& RetDec::refinements.count(start) == 0)
+		{
+			ctx->backgroundDecompilation({f});
+		}
 	}
 }
 
@@ -19,6 +19,32 @@ struct fullDecompilation_ah_t : public action_handler_t
 	virtual action_state_t idaapi update(action_update_ctx_t*) override;
 };
 
+struct openOutput_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:ActionOpenOutput";
+	inline static const char* actionLabel = "Open RetDec output...";
+	inline static const char* actionHotkey = "";
+
+	RetDec& plg;
+	openOutput_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
+struct search_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:ActionSearch";
+	inline static const char* actionLabel = "Search decompiled code (RetDec)...";
+	inline static const char* actionHotkey = "Ctrl+Shift+F";
+
+	RetDec& plg;
+	search_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
 struct jump2asm_ah_t : public action_handler_t
 {
 	inline static const char* actionName = "retdec:ActionJump2Asm";
@@ -45,6 +71,45 @@ struct copy2asm_ah_t : public action_handler_t
 	virtual action_state_t idaapi update(action_update_ctx_t*) override;
 };
 
+struct copy2asmFunctions_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:ActionCopy2AsmFunctions";
+	inline static const char* actionLabel = "Copy to assembly (RetDec)";
+	inline static const char* actionHotkey = "";
+
+	RetDec& plg;
+	copy2asmFunctions_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
+struct nextOccurrence_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:NextOccurrence";
+	inline static const char* actionLabel = "Next occurrence";
+	inline static const char* actionHotkey = "Ctrl+Shift+Down";
+
+	RetDec& plg;
+	nextOccurrence_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
+struct prevOccurrence_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:PrevOccurrence";
+	inline static const char* actionLabel = "Previous occurrence";
+	inline static const char* actionHotkey = "Ctrl+Shift+Up";
+
+	RetDec& plg;
+	prevOccurrence_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
 struct funcComment_ah_t : public action_handler_t
 {
 	inline static const char* actionName = "retdec:ActionFunctionComment";
@@ -71,6 +136,19 @@ struct renameGlobalObj_ah_t : public action_handler_t
 	virtual action_state_t idaapi update(action_update_ctx_t*) override;
 };
 
+struct renameLocal_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:RenameLocal";
+	inline static const char* actionLabel = "Rename local variable";
+	inline static const char* actionHotkey = "N";
+
+	RetDec& plg;
+	renameLocal_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
 struct openXrefs_ah_t : public action_handler_t
 {
 	inline static const char* actionName = "retdec:OpenXrefs";
@@ -84,6 +162,19 @@ struct openXrefs_ah_t : public action_handler_t
 	virtual action_state_t idaapi update(action_update_ctx_t*) override;
 };
 
+struct pseudocodeXrefs_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:PseudocodeXrefs";
+	inline static const char* actionLabel = "Open pseudocode xrefs";
+	inline static const char* actionHotkey = "Shift+X";
+
+	RetDec& plg;
+	pseudocodeXrefs_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
 struct openCalls_ah_t : public action_handler_t
 {
 	inline static const char* actionName = "retdec:OpenCalls";
@@ -110,6 +201,32 @@ struct changeFuncType_ah_t : public action_handler_t
 	virtual action_state_t idaapi update(action_update_ctx_t*) override;
 };
 
+struct profileDecompilation_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:ProfileDecompilation";
+	inline static const char* actionLabel = "Decompile with profile...";
+	inline static const char* actionHotkey = "";
+
+	RetDec& plg;
+	profileDecompilation_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
+struct backgroundDecompilation_ah_t : public action_handler_t
+{
+	inline static const char* actionName = "retdec:BackgroundDecompilation";
+	inline static const char* actionLabel = "Decompile in background (RetDec)";
+	inline static const char* actionHotkey = "";
+
+	RetDec& plg;
+	backgroundDecompilation_ah_t(RetDec& p);
+
+	virtual int idaapi activate(action_activation_ctx_t*) override;
+	virtual action_state_t idaapi update(action_update_ctx_t*) override;
+};
+
 bool idaapi cv_double(TWidget* cv, int shift, void* ud);
 void idaapi cv_adjust_place(TWidget* v, lochist_entry_t* loc, void* ud);
 int idaapi cv_get_place_xcoord(
@@ -12,6 +12,7 @@
 #include <bytes.hpp>
 #include <demangle.hpp>
 #include <diskio.hpp>
+#include <entry.hpp>
 #include <frame.hpp>
 #include <funcs.hpp>
 #include <idp.hpp>
@@ -33,12 +34,23 @@
 #define PRINT_WARNING true
 #define PRINT_INFO    true
 
+// Stand-alone tools (e.g. the replay driver) share some of the plugin's
+// sources but do not run inside IDA -> print to the standard error instead.
+#ifdef RETDEC_IDAPLUGIN_HEADLESS
+#include <iostream>
+#define PLUGIN_MSG(str)     std::cerr << str
+#define PLUGIN_WARNING(str) std::cerr << str << std::endl
+#else
+#define PLUGIN_MSG(str)     msg("%s", str)
+#define PLUGIN_WARNING(str) warning("%s", str)
+#endif
+
 #define DBG_MSG(body)                                                          \
 	if (PRINT_DEBUG)                                                           \
 	{                                                                          \
 		std::stringstream ss;                                                  \
 		ss << std::showbase << body;                                           \
-		msg("%s", ss.str().c_str());                                           \
+		PLUGIN_MSG(ss.str().c_str());                                          \
 	}
 /// Use this only for non-critical error messages.
 #define ERROR_MSG(body)                                                        \
@@ -46,7 +58,7 @@
 	{                                                                          \
 		std::stringstream ss;                                                  \
 		ss << std::showbase << "[RetDec error]  :\t" << body;                  \
-		msg("%s", ss.str().c_str());                                           \
+		PLUGIN_MSG(ss.str().c_str());                                          \
 	}
 /// Use this only for user info warnings.
 #define WARNING_MSG(body)                                                      \
@@ -54,7 +66,7 @@
 	{                                                                          \
 		std::stringstream ss;                                                  \
 		ss << std::showbase << "[RetDec warning]:\t" << body;                  \
-		msg("%s", ss.str().c_str());                                           \
+		PLUGIN_MSG(ss.str().c_str());                                          \
 	}
 /// Use this to inform user.
 #define INFO_MSG(body)                                                         \
@@ -62,7 +74,7 @@
 	{                                                                          \
 		std::stringstream ss;                                                  \
 		ss << std::showbase << "[RetDec info]   :\t" << body;                  \
-		msg("%s", ss.str().c_str());                                           \
+		PLUGIN_MSG(ss.str().c_str());                                          \
 	}
 
 /// Use instead of IDA SDK's warning() function.
@@ -70,7 +82,7 @@
 	{                                                                          \
 		std::stringstream ss;                                                  \
 		ss << std::showbase << body;                                           \
-		warning("%s", ss.str().c_str());                                       \
+		PLUGIN_WARNING(ss.str().c_str());                                      \
 	}
 
 /**
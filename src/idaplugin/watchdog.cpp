@@ -0,0 +1,191 @@
+
+#include <sstream>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+
+#include "profiler.h"
+#include "watchdog.h"
+
+namespace {
+
+thread_local Watchdog* activeWatchdog = nullptr;
+
+/**
+ * Checks the budget of the active watchdog. When exceeded, aborts
+ * the pipeline by WatchdogCancelled.
+ */
+class WatchdogPass : public llvm::ModulePass
+{
+	public:
+		static char ID;
+		WatchdogPass() : ModulePass(ID) {}
+
+		bool runOnModule(llvm::Module& m) override
+		{
+			auto* w = Watchdog::current();
+			if (w && w->check())
+			{
+				throw WatchdogCancelled(w->getReason());
+			}
+			return false;
+		}
+};
+
+char WatchdogPass::ID = 0;
+
+llvm::RegisterPass<WatchdogPass> watchdogPass(
+		Watchdog::passName.c_str(),
+		"RetDec IDA plugin decompilation budget watchdog",
+		false, // Only looks at CFG
+		false // Analysis Pass
+);
+
+} // anonymous namespace
+
+Watchdog::Watchdog(unsigned timeLimit, unsigned memoryLimit)
+		: _outer(activeWatchdog)
+		, _timeLimit(timeLimit)
+		, _memoryLimit(std::size_t(memoryLimit) * 1024 * 1024)
+{
+	start();
+	activeWatchdog = this;
+}
+
+Watchdog::~Watchdog()
+{
+	activeWatchdog = _outer;
+}
+
+Watchdog* Watchdog::current()
+{
+	return activeWatchdog;
+}
+
+std::vector<std::string> Watchdog::instrument(
+		const std::vector<std::string>& passes)
+{
+	std::vector<std::string> ret;
+	for (auto& p : passes)
+	{
+		ret.push_back(p);
+		ret.push_back(passName);
+	}
+	// Nothing to watch after the last pass.
+	if (!ret.empty())
+	{
+		ret.pop_back();
+	}
+	return ret;
+}
+
+void Watchdog::setPasses(const std::vector<std::string>& passes)
+{
+	_passes.clear();
+	for (auto& p : passes)
+	{
+		if (p != passName)
+		{
+			_passes.push_back(p);
+		}
+	}
+}
+
+void Watchdog::setProgressCallback(ProgressCallback callback)
+{
+	_progress = std::move(callback);
+}
+
+bool Watchdog::progress(
+		const std::string& pass,
+		unsigned done,
+		unsigned total)
+{
+	if (!_cancelled && _progress && _progress(pass, done, total))
+	{
+		_userCancelled = true;
+		cancel("cancelled by the user");
+	}
+	return _cancelled;
+}
+
+bool Watchdog::isEnabled() const
+{
+	return _timeLimit || _memoryLimit;
+}
+
+void Watchdog::start()
+{
+	_start = std::chrono::steady_clock::now();
+	_startRss = _memoryLimit ? getProcessRss() : 0;
+}
+
+bool Watchdog::check()
+{
+	if (_cancelled)
+	{
+		return true;
+	}
+
+	++_done;
+	if (progress(
+			_done <= _passes.size() ? _passes[_done - 1] : std::string(),
+			_done,
+			_passes.size()))
+	{
+		return true;
+	}
+
+	std::chrono::duration<double> elapsed =
+			std::chrono::steady_clock::now() - _start;
+	std::size_t rss = _memoryLimit ? getProcessRss() : 0;
+
+	std::stringstream reason;
+	if (_timeLimit && elapsed.count() > _timeLimit)
+	{
+		reason << "time limit of " << _timeLimit << " s exceeded";
+	}
+	else if (_memoryLimit && rss > _startRss && rss - _startRss > _memoryLimit)
+	{
+		reason << "memory limit of " << _memoryLimit / (1024 * 1024)
+				<< " MB exceeded";
+	}
+	else
+	{
+		return false;
+	}
+
+	cancel(reason.str());
+	return true;
+}
+
+void Watchdog::cancel(const std::string& reason)
+{
+	_cancelled = true;
+	_reason = reason;
+}
+
+bool Watchdog::isCancelled() const
+{
+	return _cancelled;
+}
+
+bool Watchdog::isUserCancelled() const
+{
+	return _userCancelled;
+}
+
+const std::string& Watchdog::getReason() const
+{
+	return _reason;
+}
+
+unsigned Watchdog::getTimeLimit() const
+{
+	return _timeLimit;
+}
+
+unsigned Watchdog::getMemoryLimit() const
+{
+	return _memoryLimit / (1024 * 1024);
+}
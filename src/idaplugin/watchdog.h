@@ -0,0 +1,106 @@
+
+#ifndef RETDEC_WATCHDOG_H
+#define RETDEC_WATCHDOG_H
+
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Thrown out of retdec::decompile() by the watchdog pass when the active
+ * watchdog is cancelled, see Watchdog::getReason().
+ */
+class WatchdogCancelled : public std::runtime_error
+{
+	public:
+		using std::runtime_error::runtime_error;
+};
+
+/**
+ * Time and memory budget, progress, and cancellation of one decompilation.
+ *
+ * RetDec cannot be interrupted from the outside. Therefore, a watchdog
+ * pass is injected between the passes of the pipeline (see instrument()).
+ * When the budget of the active watchdog is exceeded, the watchdog is
+ * cancelled and the pass throws WatchdogCancelled, which aborts the rest
+ * of the pipeline. The IR is not touched - analyses of the following
+ * passes may keep pointers into it. Output of a cancelled decompilation
+ * must be thrown away.
+ *
+ * The same pass reports progress (see setProgressCallback()), which can
+ * also cancel the decompilation - e.g. by the user.
+ *
+ * There is at most one active watchdog per thread, the one created last.
+ */
+class Watchdog
+{
+	public:
+		/// Called with the name of the finished pass, the number of the
+		/// finished passes, and the number of all the passes. Called also
+		/// with an empty name when there is no progress to report, but the
+		/// cancellation should be polled. Returns \c true to cancel.
+		using ProgressCallback = std::function<
+				bool(const std::string& pass, unsigned done, unsigned total)>;
+
+	public:
+		/// \p timeLimit in seconds, \p memoryLimit in MB (growth of
+		/// the process's RSS). 0 = unlimited.
+		Watchdog(unsigned timeLimit, unsigned memoryLimit);
+		~Watchdog();
+
+		/// Active watchdog of this thread, or \c nullptr.
+		static Watchdog* current();
+
+		/// Name of the registered watchdog pass.
+		inline static const std::string passName = "retdec-idaplugin-watchdog";
+		/// Pass list with the watchdog pass after every pass.
+		static std::vector<std::string> instrument(
+				const std::vector<std::string>& passes
+		);
+
+		/// Passes of the watched decompilation, used to report progress.
+		/// Watchdog passes in \p passes are ignored.
+		void setPasses(const std::vector<std::string>& passes);
+		void setProgressCallback(ProgressCallback callback);
+		/// Report progress (see ProgressCallback).
+		/// Returns \c true if cancelled.
+		bool progress(const std::string& pass, unsigned done, unsigned total);
+
+		/// Has a limit?
+		bool isEnabled() const;
+		/// (Re)start measuring the budget - e.g. after waiting for
+		/// another decompilation.
+		void start();
+		/// Called by the watchdog pass - report progress and check
+		/// the budget, cancel if exceeded.
+		/// Returns \c true if cancelled.
+		bool check();
+		/// Cancel from the outside - e.g. by the decompilation worker
+		/// (see worker.h) whose own watchdog was cancelled.
+		void cancel(const std::string& reason);
+		bool isCancelled() const;
+		/// Cancelled by the progress callback, not by the budget.
+		bool isUserCancelled() const;
+		/// Why was the watchdog cancelled.
+		const std::string& getReason() const;
+
+		unsigned getTimeLimit() const;
+		unsigned getMemoryLimit() const;
+
+	private:
+		Watchdog* _outer = nullptr;
+		std::chrono::steady_clock::time_point _start;
+		unsigned _timeLimit = 0;
+		std::size_t _memoryLimit = 0;
+		std::size_t _startRss = 0;
+		bool _cancelled = false;
+		bool _userCancelled = false;
+		std::string _reason;
+		std::vector<std::string> _passes;
+		unsigned _done = 0;
+		ProgressCallback _progress;
+};
+
+#endif
@@ -0,0 +1,840 @@
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <csignal>
+#include <cerrno>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <retdec/retdec/retdec.h>
+
+#include "tokenstream.h"
+#include "watchdog.h"
+#include "worker.h"
+
+DecompilerWorker& decompilerWorker()
+{
+	static DecompilerWorker w;
+	return w;
+}
+
+DecompilerWorker::~DecompilerWorker()
+{
+	stop();
+}
+
+bool DecompilerWorker::isEnabled() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _enabled;
+}
+
+#ifdef _WIN32
+
+bool DecompilerWorker::isSupported()
+{
+	return false;
+}
+
+bool DecompilerWorker::start(const Limits&, unsigned)
+{
+	return true;
+}
+
+void DecompilerWorker::stop()
+{
+	_enabled = false;
+}
+
+unsigned DecompilerWorker::getWorkers() const
+{
+	return 0;
+}
+
+void DecompilerWorker::respawn()
+{
+}
+
+bool DecompilerWorker::decompile(
+		const retdec::config::Config&,
+		std::string*,
+		std::string& error)
+{
+	error = "decompilation worker is not supported on this system";
+	return true;
+}
+
+bool DecompilerWorker::spawn(Zygote&)
+{
+	return true;
+}
+
+void DecompilerWorker::kill(Zygote&)
+{
+}
+
+bool DecompilerWorker::canSpawn() const
+{
+	return false;
+}
+
+#else
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS - SO_NOSIGPIPE is set on the sockets.
+#endif
+
+namespace {
+
+/// How often [ms] cancellation is polled while waiting for a worker.
+const int progressPeriod = 100;
+/// How long [ms] a zygote may take to answer a cancellation.
+const int cancelTimeout = 5000;
+
+/**
+ * Request sent to the zygote, followed by the config JSON.
+ */
+struct Request
+{
+	uint32_t memoryLimit;
+	uint32_t cpuLimit;
+	/// Budget of the worker's watchdog.
+	uint32_t timeBudget;
+	uint32_t memoryBudget;
+	uint32_t wantOutput;
+	uint64_t configSize;
+	/// Kill the running worker. No config follows. Ignored if the worker
+	/// has already finished.
+	uint32_t cancel;
+};
+
+/**
+ * Response from the worker (or the zygote), followed by the payload - the
+ * output, the error message, or the progress. Any number of progress
+ * responses precede the final one.
+ */
+struct Response
+{
+	enum Status : uint32_t
+	{
+		OK = 0,
+		FAILED,
+		CANCELLED,
+		/// Not final - finished passes, number of passes, pass name.
+		PROGRESS,
+	};
+
+	uint32_t status;
+	uint64_t size;
+};
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool writeAll(int fd, const void* data, std::size_t size)
+{
+	auto* p = static_cast<const char*>(data);
+	while (size)
+	{
+		auto n = ::send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return true;
+		}
+		p += n;
+		size -= n;
+	}
+	return false;
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool readAll(int fd, void* data, std::size_t size)
+{
+	auto* p = static_cast<char*>(data);
+	while (size)
+	{
+		auto n = ::recv(fd, p, size, 0);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return true;
+		}
+		p += n;
+		size -= n;
+	}
+	return false;
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool readString(int fd, std::size_t size, std::string& out)
+{
+	out.resize(size);
+	return size && readAll(fd, &out[0], size);
+}
+
+std::string makeResponse(Response::Status status, const std::string& payload)
+{
+	Response r;
+	std::memset(&r, 0, sizeof(r));
+	r.status = status;
+	r.size = payload.size();
+
+	std::string ret(reinterpret_cast<const char*>(&r), sizeof(r));
+	ret += payload;
+	return ret;
+}
+
+std::string makeProgress(const std::string& pass, unsigned done, unsigned total)
+{
+	uint32_t counts[2] = {done, total};
+	std::string payload(reinterpret_cast<const char*>(counts), sizeof(counts));
+	payload += pass;
+	return makeResponse(Response::PROGRESS, payload);
+}
+
+/**
+ * Size of the first complete response in \p data, or 0.
+ */
+std::size_t responseSize(const std::string& data)
+{
+	if (data.size() < sizeof(Response))
+	{
+		return 0;
+	}
+	Response r;
+	std::memcpy(&r, data.data(), sizeof(r));
+	auto size = sizeof(r) + r.size;
+	return data.size() >= size ? size : 0;
+}
+
+void setNoSigPipe(int fd)
+{
+#ifdef SO_NOSIGPIPE
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+	(void) fd;
+#endif
+}
+
+void setLimit(int resource, rlim_t soft, rlim_t hard)
+{
+	struct rlimit l;
+	l.rlim_cur = soft;
+	l.rlim_max = hard;
+	setrlimit(resource, &l);
+}
+
+/**
+ * Size of this process' address space [B], 0 if unknown. Workers inherit
+ * the whole address space of IDA.
+ */
+rlim_t getAddressSpace()
+{
+	std::ifstream statm("/proc/self/statm");
+	unsigned long pages = 0;
+	if (statm >> pages)
+	{
+		return rlim_t(pages) * rlim_t(sysconf(_SC_PAGESIZE));
+	}
+	return 0;
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool sendCancel(int fd)
+{
+	Request req;
+	std::memset(&req, 0, sizeof(req));
+	req.cancel = 1;
+	return writeAll(fd, &req, sizeof(req));
+}
+
+/**
+ * Decompile in the worker process and write the response into \p fd.
+ * Must not touch IDA's API.
+ */
+[[noreturn]] void workerMain(
+		const Request& req,
+		const std::string& configJson,
+		int fd)
+{
+	// IDA's crash handlers must not run in the worker.
+	for (int sig : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGXCPU})
+	{
+		signal(sig, SIG_DFL);
+	}
+	// On top of what is inherited. Not enforced where the size of
+	// the address space is unknown (no /proc), the watchdog's budget still
+	// is.
+	rlim_t inherited = 0;
+	if (req.memoryLimit && (inherited = getAddressSpace()))
+	{
+		rlim_t l = inherited + rlim_t(req.memoryLimit) * 1024 * 1024;
+		setLimit(RLIMIT_AS, l, l);
+	}
+	if (req.cpuLimit)
+	{
+		// SIGXCPU at the soft limit, SIGKILL at the hard one.
+		setLimit(RLIMIT_CPU, req.cpuLimit, req.cpuLimit + 1);
+	}
+
+	auto status = Response::OK;
+	std::string payload;
+	try
+	{
+		auto config = retdec::config::Config::fromJsonString(configJson);
+		Watchdog watchdog(req.timeBudget, req.memoryBudget);
+		watchdog.setPasses(config.parameters.llvmPasses);
+		watchdog.setProgressCallback([fd](
+				const std::string& pass,
+				unsigned done,
+				unsigned total)
+		{
+			auto r = makeProgress(pass, done, total);
+			writeAll(fd, r.data(), r.size());
+			return false; // IDA cancels by killing the worker
+		});
+		auto rc = retdec::decompile(
+				config,
+				req.wantOutput ? &payload : nullptr
+		);
+		if (watchdog.isCancelled())
+		{
+			status = Response::CANCELLED;
+			payload = watchdog.getReason();
+		}
+		else if (rc != 0)
+		{
+			status = Response::FAILED;
+			payload = "decompilation error code = " + std::to_string(rc);
+		}
+		else if (req.wantOutput)
+		{
+			// Parse the JSON here, not in IDA, and send much less. If it
+			// cannot be parsed, IDA gets the JSON and reports the error.
+			TokenWriter writer;
+			std::string error;
+			if (!tryParseTokens(payload, BADADDR, writer, error))
+			{
+				payload = writer.finish();
+			}
+		}
+	}
+	catch (const WatchdogCancelled& e)
+	{
+		status = Response::CANCELLED;
+		payload = e.what();
+	}
+	catch (const std::bad_alloc&)
+	{
+		status = Response::FAILED;
+		payload = req.memoryLimit
+				? "memory limit of " + std::to_string(req.memoryLimit)
+						+ " MB exceeded"
+				: "out of memory";
+	}
+	catch (const std::exception& e)
+	{
+		status = Response::FAILED;
+		payload = e.what();
+	}
+	catch (...)
+	{
+		status = Response::FAILED;
+		payload = "unknown";
+	}
+
+	auto r = makeResponse(status, payload);
+	_exit(writeAll(fd, r.data(), r.size()) ? 1 : 0);
+}
+
+std::string describeExit(int status, const Request& req)
+{
+	if (WIFSIGNALED(status))
+	{
+		int sig = WTERMSIG(status);
+		if (req.cpuLimit && (sig == SIGXCPU || sig == SIGKILL))
+		{
+			return "CPU time limit of " + std::to_string(req.cpuLimit)
+					+ " s exceeded";
+		}
+		return std::string("decompiler crashed - ") + strsignal(sig);
+	}
+	return "decompiler exited with code "
+			+ std::to_string(WEXITSTATUS(status));
+}
+
+/**
+ * Run one decompilation in a new worker, relay its responses into \p fd.
+ * A cancellation from \p fd kills the worker, the zygote lives on.
+ * Returns \c true if IDA is gone.
+ */
+bool runWorker(const Request& req, const std::string& config, int fd)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+	{
+		auto r = makeResponse(
+				Response::FAILED,
+				std::string("socketpair() failed: ") + strerror(errno)
+		);
+		return writeAll(fd, r.data(), r.size());
+	}
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		auto r = makeResponse(
+				Response::FAILED,
+				std::string("fork() failed: ") + strerror(errno)
+		);
+		return writeAll(fd, r.data(), r.size());
+	}
+	if (pid == 0)
+	{
+		close(fd);
+		close(fds[0]);
+		workerMain(req, config, fds[1]);
+	}
+
+	// Relay whole responses only - a crashed worker may leave a partial one.
+	close(fds[1]);
+	std::string data;
+	bool final = false;
+	bool gone = false;
+	char buffer[64 * 1024];
+	while (!gone)
+	{
+		struct pollfd p[2] = {{fds[0], POLLIN, 0}, {fd, POLLIN, 0}};
+		if (::poll(p, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		if (p[1].revents)
+		{
+			// Cancelled, or IDA is gone - the worker's EOF follows.
+			Request cancel;
+			gone = readAll(fd, &cancel, sizeof(cancel));
+			::kill(pid, SIGKILL);
+			continue;
+		}
+
+		auto n = ::recv(fds[0], buffer, sizeof(buffer), 0);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			break;
+		}
+		data.append(buffer, n);
+
+		std::size_t size = 0;
+		while (!gone && (size = responseSize(data)))
+		{
+			Response r;
+			std::memcpy(&r, data.data(), sizeof(r));
+			final |= r.status != Response::PROGRESS;
+			gone = writeAll(fd, data.data(), size);
+			data.erase(0, size);
+		}
+	}
+	close(fds[0]);
+	if (gone)
+	{
+		::kill(pid, SIGKILL);
+	}
+
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+	{
+	}
+
+	if (gone || final)
+	{
+		return gone;
+	}
+	auto r = makeResponse(Response::FAILED, describeExit(status, req));
+	return writeAll(fd, r.data(), r.size());
+}
+
+/**
+ * Serve the requests until IDA closes the socket.
+ * Must not touch IDA's API.
+ */
+[[noreturn]] void zygoteMain(int fd)
+{
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGINT, SIG_IGN);
+
+	while (true)
+	{
+		Request req;
+		std::string config;
+		if (readAll(fd, &req, sizeof(req)))
+		{
+			break;
+		}
+		if (req.cancel)
+		{
+			continue; // of a worker which has already finished
+		}
+		if (readString(fd, req.configSize, config))
+		{
+			break;
+		}
+
+		if (runWorker(req, config, fd))
+		{
+			break;
+		}
+	}
+	_exit(0);
+}
+
+} // anonymous namespace
+
+bool DecompilerWorker::isSupported()
+{
+	return true;
+}
+
+bool DecompilerWorker::start(const Limits& limits, unsigned workers)
+{
+	stop();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_limits = limits;
+	_mainThread = std::this_thread::get_id();
+	_zygotes.resize(std::max(workers, 1u));
+	for (auto& z : _zygotes)
+	{
+		if (spawn(z))
+		{
+			for (auto& o : _zygotes)
+			{
+				kill(o);
+			}
+			return true;
+		}
+	}
+	_enabled = true;
+	return false;
+}
+
+void DecompilerWorker::stop()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_enabled = false;
+
+	// Running decompilations fail, their threads then release the zygotes.
+	for (auto& z : _zygotes)
+	{
+		if (z.busy && z.pid > 0)
+		{
+			::kill(-z.pid, SIGKILL);
+		}
+	}
+	_cv.notify_all();
+	_cv.wait(lock, [this]()
+	{
+		return std::none_of(_zygotes.begin(), _zygotes.end(),
+				[](const Zygote& z) { return z.busy; });
+	});
+
+	for (auto& z : _zygotes)
+	{
+		kill(z);
+	}
+}
+
+unsigned DecompilerWorker::getWorkers() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _enabled ? _zygotes.size() : 0;
+}
+
+bool DecompilerWorker::canSpawn() const
+{
+	return _enabled
+			&& std::this_thread::get_id() == _mainThread
+			&& _active == 0;
+}
+
+void DecompilerWorker::respawn()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!canSpawn())
+		{
+			return;
+		}
+		for (auto& z : _zygotes)
+		{
+			if (z.pid < 0)
+			{
+				spawn(z);
+			}
+		}
+	}
+	_cv.notify_all();
+}
+
+bool DecompilerWorker::spawn(Zygote& z)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+	{
+		return true;
+	}
+	setNoSigPipe(fds[0]);
+	setNoSigPipe(fds[1]);
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return true;
+	}
+	if (pid == 0)
+	{
+		// Own process group - kill() takes the running worker down too.
+		setpgid(0, 0);
+		close(fds[0]);
+		// Other zygotes must see EOF when IDA closes their sockets.
+		for (auto& o : _zygotes)
+		{
+			if (o.fd >= 0)
+			{
+				close(o.fd);
+			}
+		}
+		zygoteMain(fds[1]);
+	}
+
+	setpgid(pid, pid);
+	close(fds[1]);
+	z.pid = pid;
+	z.fd = fds[0];
+	return false;
+}
+
+void DecompilerWorker::kill(Zygote& z)
+{
+	if (z.fd >= 0)
+	{
+		close(z.fd);
+		z.fd = -1;
+	}
+	if (z.pid > 0)
+	{
+		::kill(-z.pid, SIGKILL);
+		while (waitpid(z.pid, nullptr, 0) < 0 && errno == EINTR)
+		{
+		}
+		z.pid = -1;
+	}
+}
+
+bool DecompilerWorker::decompile(
+		const retdec::config::Config& config,
+		std::string* output,
+		std::string& error)
+{
+	auto* watchdog = Watchdog::current();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_active;
+	}
+	auto json = config.generateJsonString();
+
+	Request req;
+	std::memset(&req, 0, sizeof(req));
+	req.timeBudget = watchdog ? watchdog->getTimeLimit() : 0;
+	req.memoryBudget = watchdog ? watchdog->getMemoryLimit() : 0;
+	req.wantOutput = output != nullptr;
+	req.configSize = json.size();
+
+	Zygote* z = nullptr;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		auto free = [this](bool alive)
+		{
+			return std::find_if(_zygotes.begin(), _zygotes.end(),
+					[alive](const Zygote& z)
+					{
+						return !z.busy && (z.pid > 0) == alive;
+					});
+		};
+		while (z == nullptr)
+		{
+			if (!_enabled)
+			{
+				--_active;
+				error = "decompilation worker is not running";
+				return true;
+			}
+
+			auto it = free(true);
+			if (it != _zygotes.end())
+			{
+				z = &*it;
+				break;
+			}
+			// Dead zygotes are forked again only when no other thread is
+			// inside decompile() - none holds locks the child would inherit.
+			--_active;
+			it = free(false);
+			if (it != _zygotes.end() && canSpawn())
+			{
+				++_active;
+				if (spawn(*it))
+				{
+					--_active;
+					error = std::string("unable to start decompilation worker: ")
+							+ strerror(errno);
+					return true;
+				}
+				z = &*it;
+				break;
+			}
+			_cv.wait(lock);
+			++_active;
+		}
+		z->busy = true;
+		req.memoryLimit = _limits.memoryLimit;
+		req.cpuLimit = _limits.cpuLimit;
+	}
+
+	Response resp;
+	std::string payload;
+	bool died = writeAll(z->fd, &req, sizeof(req))
+			|| writeAll(z->fd, json.data(), json.size());
+	// A cancelled decompilation still ends by a final response - after
+	// the zygote kills the worker.
+	bool cancelled = false;
+	int cancelWait = 0;
+	while (!died)
+	{
+		// Without a watchdog, there is nobody to report to.
+		struct pollfd p = {z->fd, POLLIN, 0};
+		int n = ::poll(&p, 1, watchdog || cancelled ? progressPeriod : -1);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n == 0)
+		{
+			if (cancelled)
+			{
+				died = (cancelWait += progressPeriod) >= cancelTimeout;
+			}
+			else if (watchdog->progress(std::string(), 0, 0))
+			{
+				cancelled = true;
+				died = sendCancel(z->fd);
+			}
+			continue;
+		}
+		if (n < 0
+				|| readAll(z->fd, &resp, sizeof(resp))
+				|| readString(z->fd, resp.size, payload))
+		{
+			died = true;
+		}
+		else if (resp.status != Response::PROGRESS)
+		{
+			break;
+		}
+		else if (watchdog && !cancelled
+				&& payload.size() >= 2 * sizeof(uint32_t))
+		{
+			uint32_t counts[2];
+			std::memcpy(counts, payload.data(), sizeof(counts));
+			if (watchdog->progress(
+					payload.substr(sizeof(counts)),
+					counts[0],
+					counts[1]))
+			{
+				cancelled = true;
+				died = sendCancel(z->fd);
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		// Forked again by respawn(), or by the next decompilation.
+		if (died)
+		{
+			kill(*z);
+		}
+		z->busy = false;
+		--_active;
+	}
+	_cv.notify_all();
+
+	if (died)
+	{
+		error = "decompilation worker died";
+		return true;
+	}
+	if (cancelled)
+	{
+		return false;
+	}
+
+	switch (resp.status)
+	{
+		case Response::OK:
+			if (output)
+			{
+				*output = std::move(payload);
+			}
+			return false;
+		case Response::CANCELLED:
+			if (watchdog)
+			{
+				watchdog->cancel(payload);
+			}
+			return false;
+		default:
+			error = payload;
+			return true;
+	}
+}
+
+#endif
@@ -0,0 +1,106 @@
+
+#ifndef RETDEC_WORKER_H
+#define RETDEC_WORKER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+/**
+ * Decompilation in separate processes - a crash or a runaway allocation
+ * inside RetDec does not take IDA (and the unsaved database) down.
+ *
+ * A pool of zygote processes is forked from IDA when the pool is started -
+ * i.e. when the plugin is loaded, before any decompilation or background
+ * thread runs. Zygotes already hold the RetDec libraries, and for each
+ * decompilation a zygote forks a short-lived worker with hard limits
+ * (address space, CPU time). The config is sent to the zygote serialized
+ * to JSON over a socket, and the worker streams the output back.
+ * A cancelled decompilation kills only its worker - the zygote kills it on
+ * request. If a zygote itself dies, it is forked again only from the main
+ * thread, while no other decompilation is running (see respawn()) - IDA's
+ * threads are running by then, and the fork must not inherit locks held by
+ * the plugin's ones.
+ *
+ * Each zygote serves one decompilation at a time, i.e. there are as many
+ * concurrent decompilations as zygotes. Workers do not share RetDec's
+ * global state - decompilerMutex() does not have to be held.
+ *
+ * Budget of the active watchdog (see watchdog.h) is enforced by the worker,
+ * and its cancellation is propagated back to the active watchdog.
+ *
+ * Available only on POSIX systems.
+ */
+class DecompilerWorker
+{
+	public:
+		/// Hard limits of one decompilation. 0 = unlimited.
+		struct Limits
+		{
+			/// Address space [MB] a worker may add to the one inherited from
+			/// IDA (RLIMIT_AS). Enforced only where /proc is available.
+			unsigned memoryLimit = 0;
+			/// CPU time [s] (RLIMIT_CPU).
+			unsigned cpuLimit = 0;
+		};
+
+	public:
+		~DecompilerWorker();
+
+		static bool isSupported();
+
+		/// Fork \p workers zygotes.
+		/// Returns \c true if something went wrong.
+		bool start(const Limits& limits, unsigned workers = 1);
+		void stop();
+		bool isEnabled() const;
+		unsigned getWorkers() const;
+		/// Fork the dead zygotes again, if called by the main thread while
+		/// no decompilation is running.
+		void respawn();
+
+		/// Same as retdec::decompile(), but in a worker. Blocks until
+		/// a zygote is free. JSON output is converted into a binary token
+		/// stream (see tokenstream.h) by the worker.
+		/// Returns \c true if something went wrong, \p error is set then.
+		bool decompile(
+				const retdec::config::Config& config,
+				std::string* output,
+				std::string& error
+		);
+
+	private:
+		struct Zygote
+		{
+			int pid = -1;
+			int fd = -1;
+			bool busy = false;
+		};
+
+		bool spawn(Zygote& z);
+		static void kill(Zygote& z);
+		/// Must be called with _mutex locked.
+		bool canSpawn() const;
+
+	private:
+		mutable std::mutex _mutex;
+		std::condition_variable _cv;
+		Limits _limits;
+		bool _enabled = false;
+		std::vector<Zygote> _zygotes;
+		/// Thread which started the zygotes, the only one forking them again.
+		std::thread::id _mainThread;
+		/// Number of the threads in decompile() not waiting for a zygote.
+		unsigned _active = 0;
+};
+
+/**
+ * The worker used by all the decompilations.
+ */
+DecompilerWorker& decompilerWorker();
+
+#endif
@@ -0,0 +1,247 @@
+
+#include <algorithm>
+
+#include "xrefs.h"
+
+namespace {
+
+/**
+ * Collects the references of a function. Tracks YX the same way as
+ * Function does when the tokens are appended to it.
+ */
+class Collector : public TokenSink
+{
+	public:
+		virtual void token(
+				Token::Kind kind,
+				ea_t ea,
+				const std::string& value) override
+		{
+			if (XrefGraph::isReference(kind) && !value.empty())
+			{
+				refs.push_back({symbolKey(kind, value), _yx, ea});
+			}
+
+			if (kind == Token::Kind::NEW_LINE)
+			{
+				_yx.y += 1;
+				_yx.x = YX::starting_x;
+			}
+			else
+			{
+				_yx.x += value.size();
+			}
+		}
+
+	public:
+		struct Ref
+		{
+			std::string key;
+			YX yx;
+			ea_t ea;
+		};
+		std::vector<Ref> refs;
+
+	private:
+		YX _yx;
+};
+
+} // anonymous namespace
+
+bool XrefGraph::isReference(Token::Kind kind)
+{
+	return kind == Token::Kind::ID_FNC
+			|| kind == Token::Kind::ID_GVAR
+			|| kind == Token::Kind::ID_MEM;
+}
+
+void XrefGraph::add(ea_t fnc, const TokenSource& source, bool fromOutput)
+{
+	remove(fnc);
+
+	Collector collector;
+	if (source(fnc, collector))
+	{
+		return;
+	}
+
+	uint32_t id = _fncs.size();
+	_fncs.push_back(fnc);
+	_fromOutput.push_back(fromOutput);
+	_counts.push_back(collector.refs.size());
+	_ids[fnc] = id;
+	for (auto& r : collector.refs)
+	{
+		auto sym = _symbols.emplace(r.key, _symbols.size()).first->second;
+		_pending.push_back({sym, id, uint32_t(r.yx.y), uint32_t(r.yx.x), r.ea});
+	}
+
+	// Merges are linear in the graph -> keep their amortized cost constant
+	// per added edge.
+	if (_pending.size() > 4096 && _pending.size() > _edges.size() / 8)
+	{
+		compact();
+	}
+}
+
+void XrefGraph::remove(ea_t fnc)
+{
+	auto it = _ids.find(fnc);
+	if (it == _ids.end())
+	{
+		return;
+	}
+
+	// Edges of the removed functions are dropped lazily.
+	_removed += _counts[it->second];
+	_fncs[it->second] = BADADDR;
+	_ids.erase(it);
+	if (_removed > 4096 && _removed > size())
+	{
+		compact();
+	}
+}
+
+void XrefGraph::removeOutput()
+{
+	for (uint32_t id = 0; id < _fncs.size(); ++id)
+	{
+		if (_fromOutput[id] && _fncs[id] != BADADDR)
+		{
+			_removed += _counts[id];
+			_ids.erase(_fncs[id]);
+			_fncs[id] = BADADDR;
+		}
+	}
+	compact();
+}
+
+bool XrefGraph::contains(ea_t fnc) const
+{
+	return _ids.count(fnc);
+}
+
+std::size_t XrefGraph::size() const
+{
+	return _edges.size() + _pending.size() - _removed;
+}
+
+void XrefGraph::compact()
+{
+	std::vector<uint32_t> newIds(_fncs.size(), UINT32_MAX);
+	std::vector<ea_t> fncs;
+	std::vector<bool> fromOutput;
+	std::vector<uint32_t> counts;
+	for (uint32_t id = 0; id < _fncs.size(); ++id)
+	{
+		if (_fncs[id] != BADADDR)
+		{
+			newIds[id] = fncs.size();
+			_ids[_fncs[id]] = fncs.size();
+			fncs.push_back(_fncs[id]);
+			fromOutput.push_back(_fromOutput[id]);
+			counts.push_back(_counts[id]);
+		}
+	}
+
+	// Counting sort of the live edges by the symbol. Edges of a symbol stay
+	// in the order of their functions and YX.
+	std::size_t symbols = _symbols.size();
+	std::vector<uint32_t> offsets(symbols + 1, 0);
+	for (uint32_t s = 0; s + 1 < _offsets.size(); ++s)
+	{
+		for (auto i = _offsets[s]; i < _offsets[s + 1]; ++i)
+		{
+			if (newIds[_edges[i].fnc] != UINT32_MAX)
+			{
+				++offsets[s + 1];
+			}
+		}
+	}
+	for (auto& e : _pending)
+	{
+		if (newIds[e.fnc] != UINT32_MAX)
+		{
+			++offsets[e.symbol + 1];
+		}
+	}
+	for (std::size_t s = 0; s < symbols; ++s)
+	{
+		offsets[s + 1] += offsets[s];
+	}
+
+	std::vector<Edge> edges(offsets.back());
+	std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+	auto place = [&](uint32_t symbol, Edge e)
+	{
+		e.symbol = 0;
+		e.fnc = newIds[e.fnc];
+		edges[next[symbol]++] = e;
+	};
+	for (uint32_t s = 0; s + 1 < _offsets.size(); ++s)
+	{
+		for (auto i = _offsets[s]; i < _offsets[s + 1]; ++i)
+		{
+			if (newIds[_edges[i].fnc] != UINT32_MAX)
+			{
+				place(s, _edges[i]);
+			}
+		}
+	}
+	for (auto& e : _pending)
+	{
+		if (newIds[e.fnc] != UINT32_MAX)
+		{
+			place(e.symbol, e);
+		}
+	}
+
+	_offsets = std::move(offsets);
+	_edges = std::move(edges);
+	_pending.clear();
+	_fncs = std::move(fncs);
+	_fromOutput = std::move(fromOutput);
+	_counts = std::move(counts);
+	_removed = 0;
+}
+
+std::vector<XrefGraph::Xref> XrefGraph::find(
+		Token::Kind kind,
+		const std::string& name) const
+{
+	std::vector<Xref> xrefs;
+	auto it = _symbols.find(symbolKey(kind, name));
+	if (it == _symbols.end())
+	{
+		return xrefs;
+	}
+	uint32_t sym = it->second;
+
+	auto addEdge = [&](const Edge& e)
+	{
+		if (_fncs[e.fnc] != BADADDR)
+		{
+			xrefs.push_back({_fncs[e.fnc], YX(e.y, e.x), e.ea});
+		}
+	};
+	if (sym + 1 < _offsets.size())
+	{
+		for (auto i = _offsets[sym]; i < _offsets[sym + 1]; ++i)
+		{
+			addEdge(_edges[i]);
+		}
+	}
+	for (auto& e : _pending)
+	{
+		if (e.symbol == sym)
+		{
+			addEdge(e);
+		}
+	}
+
+	std::sort(xrefs.begin(), xrefs.end(), [](const Xref& a, const Xref& b)
+	{
+		return a.fnc < b.fnc || (a.fnc == b.fnc && a.yx < b.yx);
+	});
+	return xrefs;
+}
@@ -0,0 +1,87 @@
+
+#ifndef RETDEC_XREFS_H
+#define RETDEC_XREFS_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "token.h"
+#include "yx.h"
+
+/**
+ * Cross-references in the decompiled code - functions (ID_FNC), global
+ * variables (ID_GVAR), and members (ID_MEM) -> the exact places of
+ * the decompiled functions referring to them.
+ *
+ * Compacted references are stored as CSR (compressed sparse row) - one
+ * array of references sorted by the symbol, and offsets of the symbols into
+ * it. References of the functions added since then are pending in a small
+ * unsorted array, which is merged into the CSR once it grows. Removed
+ * functions are dropped at the merge. Adding a function thus costs only
+ * its references, not the whole graph.
+ */
+class XrefGraph
+{
+	public:
+		struct Xref
+		{
+			/// Start of the referring function.
+			ea_t fnc = BADADDR;
+			YX yx;
+			ea_t ea = BADADDR;
+		};
+
+	public:
+		/// Is \p kind a kind of the referenced tokens?
+		static bool isReference(Token::Kind kind);
+
+		/// (Re)add references of the function starting at \p fnc.
+		/// \p fromOutput marks functions added from a full decompilation.
+		void add(ea_t fnc, const TokenSource& source, bool fromOutput = false);
+		void remove(ea_t fnc);
+		/// Remove the functions added from a full decompilation.
+		void removeOutput();
+		bool contains(ea_t fnc) const;
+		/// Number of the references.
+		std::size_t size() const;
+
+		/// References to the symbol \p name of the kind \p kind, sorted by
+		/// the referring function and YX.
+		std::vector<Xref> find(Token::Kind kind, const std::string& name) const;
+
+	private:
+		struct Edge
+		{
+			/// Symbol ID, used only by the pending edges.
+			uint32_t symbol = 0;
+			/// Function ID.
+			uint32_t fnc = 0;
+			uint32_t y = 0;
+			uint32_t x = 0;
+			ea_t ea = BADADDR;
+		};
+
+		void compact();
+
+	private:
+		/// Kind + name -> symbol ID.
+		std::unordered_map<std::string, uint32_t> _symbols;
+		/// Symbol ID -> its first edge in _edges, one more at the end.
+		std::vector<uint32_t> _offsets = {0};
+		std::vector<Edge> _edges;
+		std::vector<Edge> _pending;
+
+		/// Function ID -> start, BADADDR if removed.
+		std::vector<ea_t> _fncs;
+		std::vector<bool> _fromOutput;
+		/// Start -> ID of the live functions.
+		std::unordered_map<ea_t, uint32_t> _ids;
+		/// Number of the edges of the removed functions.
+		std::size_t _removed = 0;
+		/// Number of the edges of the live functions, by function ID.
+		std::vector<uint32_t> _counts;
+};
+
+#endif
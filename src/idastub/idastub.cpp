@@ -0,0 +1,66 @@
+
+/**
+ * Minimal stand-ins for the IDA kernel functions referenced by the plugin
+ * sources that are shared with stand-alone tools (see RETDEC_IDAPLUGIN_HEADLESS
+ * in utils.h). They make the tools link and run without IDA - nothing more.
+ * E.g. there is no database, so function names are made up from addresses.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <pro.h>
+#include <funcs.hpp>
+
+void* ida_export qalloc(size_t size)
+{
+	return std::malloc(size);
+}
+
+void* ida_export qrealloc(void* alloc, size_t newsize)
+{
+	return std::realloc(alloc, newsize);
+}
+
+void* ida_export qcalloc(size_t nitems, size_t itemsize)
+{
+	return std::calloc(nitems, itemsize);
+}
+
+void ida_export qfree(void* alloc)
+{
+	std::free(alloc);
+}
+
+void* ida_export qvector_reserve(void* vec, void* old, size_t cnt, size_t elsize)
+{
+	// Memory layout of qvector<T>.
+	struct qvector_layout
+	{
+		void* array;
+		size_t n;
+		size_t alloc;
+	};
+
+	auto* v = static_cast<qvector_layout*>(vec);
+	size_t alloc = std::max(cnt, 2 * v->alloc);
+	void* p = std::realloc(old, alloc * elsize);
+	if (p == nullptr)
+	{
+		std::abort();
+	}
+	v->alloc = alloc;
+	return p;
+}
+
+ssize_t ida_export get_func_name(qstring* out, ea_t ea)
+{
+	char buff[32];
+	int n = std::snprintf(buff, sizeof(buff), "sub_%llX", (unsigned long long) ea);
+	if (out)
+	{
+		*out = buff;
+	}
+	return n;
+}
@@ -0,0 +1,385 @@
+
+/**
+ * Stand-alone decompilation replay driver.
+ *
+ * Repeats a decompilation recorded by the plugin into a replay bundle
+ * (see idaplugin/replay.h) without IDA - i.e. runs the same retdec::decompile,
+ * parseTokens(), and Function code on the same config, and reports how long
+ * each of them took. Useful for profiling, bisecting, and benchmarking.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+
+#include <retdec/retdec/retdec.h>
+#include <retdec/utils/filesystem.h>
+
+#include "idaplugin/function.h"
+#include "idaplugin/replay.h"
+#include "idaplugin/token.h"
+
+namespace {
+
+struct Arguments
+{
+	std::string bundle;
+	std::string input;
+	std::string support;
+	std::string output;
+	unsigned repeat = 1;
+};
+
+struct Bundle
+{
+	retdec::config::Config config;
+	bool hasFunction = false;
+	std::string name;
+	ea_t start = BADADDR;
+	ea_t end = BADADDR;
+};
+
+struct RunTimes
+{
+	double decompile = 0.0;
+	double parseTokens = 0.0;
+	double function = 0.0;
+};
+
+void printUsage(std::ostream& os)
+{
+	os << "Usage: retdec-replay [options] <bundle-dir>\n"
+		<< "\n"
+		<< "Repeats decompilation recorded into a replay bundle by the RetDec\n"
+		<< "IDA plugin (\"replayBundles\" option) without IDA.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  --input FILE    Binary to decompile (default: path from the bundle).\n"
+		<< "  --support DIR   RetDec support directory with ordinals, types, and\n"
+		<< "                  yara_patterns (default: paths from the bundle).\n"
+		<< "  --output FILE   Write the decompiled output to FILE.\n"
+		<< "  --repeat N      Run the decompilation N times (default: 1).\n";
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool parseArguments(int argc, char* argv[], Arguments& args)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string a = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (a == "-h" || a == "--help")
+		{
+			return true;
+		}
+		else if (a == "--input" && hasValue)
+		{
+			args.input = argv[++i];
+		}
+		else if (a == "--support" && hasValue)
+		{
+			args.support = argv[++i];
+		}
+		else if (a == "--output" && hasValue)
+		{
+			args.output = argv[++i];
+		}
+		else if (a == "--repeat" && hasValue)
+		{
+			args.repeat = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (args.bundle.empty() && a.compare(0, 2, "--") != 0)
+		{
+			args.bundle = a;
+		}
+		else
+		{
+			std::cerr << "Error: invalid argument: " << a << "\n";
+			return true;
+		}
+	}
+	return args.bundle.empty();
+}
+
+/**
+ * The plugin makes support paths absolute (relative to the IDA directory).
+ * Move them to the given support directory, i.e. replace everything up to
+ * and including "plugins/retdec/" with \p support.
+ */
+std::string rebaseSupportPath(const std::string& path, const std::string& support)
+{
+	std::string p = path;
+	std::replace(p.begin(), p.end(), '\\', '/');
+	static const std::string marker = "plugins/retdec/";
+	auto pos = p.find(marker);
+	if (pos == std::string::npos)
+	{
+		return path;
+	}
+	return (fs::path(support) / p.substr(pos + marker.size())).string();
+}
+
+std::set<std::string> rebaseSupportPaths(
+		const std::set<std::string>& paths,
+		const std::string& support)
+{
+	std::set<std::string> ret;
+	for (auto& p : paths)
+	{
+		ret.insert(rebaseSupportPath(p, support));
+	}
+	return ret;
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool loadBundle(const Arguments& args, Bundle& bundle)
+{
+	fs::path dir(args.bundle);
+	auto cfgPath = (dir / replayBundleConfig).string();
+	auto infoPath = (dir / replayBundleInfo).string();
+	if (!fs::exists(cfgPath) || !fs::exists(infoPath))
+	{
+		std::cerr << "Error: not a replay bundle: " << args.bundle << "\n";
+		return true;
+	}
+
+	std::ifstream ifs(infoPath);
+	rapidjson::IStreamWrapper isw(ifs);
+	rapidjson::Document d;
+	d.ParseStream(isw);
+	if (d.HasParseError() || !d.IsObject())
+	{
+		std::cerr << "Error: unable to parse: " << infoPath << "\n";
+		return true;
+	}
+	auto version = d.FindMember("version");
+	if (version == d.MemberEnd()
+			|| !version->value.IsUint()
+			|| version->value.GetUint() != replayBundleVersion)
+	{
+		std::cerr << "Error: unsupported replay bundle version: "
+				<< infoPath << "\n";
+		return true;
+	}
+	auto fnc = d.FindMember("function");
+	if (fnc != d.MemberEnd() && fnc->value.IsObject())
+	{
+		auto& f = fnc->value;
+		if (f.HasMember("start") && f["start"].IsUint64()
+				&& f.HasMember("end") && f["end"].IsUint64())
+		{
+			bundle.hasFunction = true;
+			bundle.start = f["start"].GetUint64();
+			bundle.end = f["end"].GetUint64();
+			if (f.HasMember("name") && f["name"].IsString())
+			{
+				bundle.name = f["name"].GetString();
+			}
+		}
+	}
+
+	try
+	{
+		bundle.config = retdec::config::Config::fromFile(cfgPath);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: unable to load " << cfgPath << ": "
+				<< e.what() << "\n";
+		return true;
+	}
+
+	auto& params = bundle.config.parameters;
+	if (!args.input.empty())
+	{
+		params.setInputFile(args.input);
+	}
+	if (!args.support.empty())
+	{
+		params.setOrdinalNumbersDirectory(rebaseSupportPath(
+				params.getOrdinalNumbersDirectory(),
+				args.support
+		));
+		params.libraryTypeInfoPaths = rebaseSupportPaths(
+				params.libraryTypeInfoPaths,
+				args.support
+		);
+		params.cryptoPatternPaths = rebaseSupportPaths(
+				params.cryptoPatternPaths,
+				args.support
+		);
+		params.staticSignaturePaths = rebaseSupportPaths(
+				params.staticSignaturePaths,
+				args.support
+		);
+	}
+	if (!fs::exists(params.getInputFile()))
+	{
+		std::cerr << "Error: input file does not exist: "
+				<< params.getInputFile() << " (use --input)\n";
+		return true;
+	}
+
+	return false;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+/**
+ * Returns \c true if something went wrong.
+ */
+bool replay(
+		const Bundle& bundle,
+		const std::string& outFile,
+		RunTimes& times,
+		std::string& output,
+		std::size_t& tokenCount)
+{
+	// Decompilation may modify the config -> each run gets a fresh copy.
+	auto config = bundle.config;
+	bool toString = config.parameters.getOutputFormat() == "json";
+	if (!toString)
+	{
+		// Do not overwrite the file the plugin has produced.
+		config.parameters.setOutputFile(!outFile.empty()
+				? outFile
+				: (fs::temp_directory_path() / "retdec-replay.c").string()
+		);
+	}
+
+	output.clear();
+	auto start = std::chrono::steady_clock::now();
+	try
+	{
+		auto rc = retdec::decompile(config, toString ? &output : nullptr);
+		if (rc != 0)
+		{
+			std::cerr << "Error: decompilation error code = " << rc << "\n";
+			return true;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: decompilation exception: " << e.what() << "\n";
+		return true;
+	}
+	times.decompile = secondsSince(start);
+
+	if (!toString || !bundle.hasFunction)
+	{
+		return false;
+	}
+
+	start = std::chrono::steady_clock::now();
+	auto ts = parseTokens(output, bundle.start);
+	times.parseTokens = secondsSince(start);
+	tokenCount = ts.size();
+
+	func_t f(bundle.start, bundle.end);
+	start = std::chrono::steady_clock::now();
+	Function fnc(&f, ts);
+	times.function = secondsSince(start);
+
+	return ts.empty();
+}
+
+void printStats(
+		const std::string& name,
+		const std::vector<RunTimes>& runs,
+		double RunTimes::* member)
+{
+	double min = runs.front().*member;
+	double max = min;
+	double sum = 0.0;
+	for (auto& r : runs)
+	{
+		min = std::min(min, r.*member);
+		max = std::max(max, r.*member);
+		sum += r.*member;
+	}
+	std::cout << std::left << std::setw(14) << name
+			<< std::right << std::fixed << std::setprecision(3)
+			<< " min " << std::setw(9) << min << " s"
+			<< "   avg " << std::setw(9) << sum / runs.size() << " s"
+			<< "   max " << std::setw(9) << max << " s\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	Arguments args;
+	if (parseArguments(argc, argv, args))
+	{
+		printUsage(std::cerr);
+		return 1;
+	}
+
+	Bundle bundle;
+	if (loadBundle(args, bundle))
+	{
+		return 1;
+	}
+
+	std::cout << "Input:    " << bundle.config.parameters.getInputFile() << "\n";
+	if (bundle.hasFunction)
+	{
+		std::cout << "Function: " << bundle.name << " @ "
+				<< std::hex << std::showbase << bundle.start << std::dec
+				<< std::noshowbase << "\n";
+	}
+
+	std::vector<RunTimes> runs;
+	std::string output;
+	std::size_t tokenCount = 0;
+	for (unsigned i = 0; i < args.repeat; ++i)
+	{
+		RunTimes times;
+		if (replay(bundle, args.output, times, output, tokenCount))
+		{
+			return 1;
+		}
+		runs.push_back(times);
+	}
+
+	std::cout << "Runs:     " << runs.size() << "\n";
+	if (bundle.hasFunction)
+	{
+		std::cout << "Output:   " << output.size() << " B JSON, "
+				<< tokenCount << " tokens\n";
+	}
+	printStats("decompile", runs, &RunTimes::decompile);
+	if (bundle.hasFunction)
+	{
+		printStats("parseTokens", runs, &RunTimes::parseTokens);
+		printStats("Function", runs, &RunTimes::function);
+	}
+
+	if (!args.output.empty() && !output.empty())
+	{
+		std::ofstream out(args.output);
+		if (!out)
+		{
+			std::cerr << "Error: unable to write: " << args.output << "\n";
+			return 1;
+		}
+		out << output;
+	}
+
+	return 0;
+}